@@ -5,15 +5,34 @@ layout(location = 0) out vec4 frag_color;
 
 uniform vec2 texture_size;
 uniform float zoom_amount;
-uniform float time;
 uniform sampler2D color_map;
+// Outline of interesting clues in r and of traces in g, see
+// packOutlineClasses()
 uniform sampler2D outline_map;
 uniform sampler2D intensity_map;
-
-const float PI = 3.1415;
-const float PI_4 = PI / 4.0;
+// Parts of outline_map and intensity_map holding the current frame
+uniform vec2 outline_scale;
+uniform vec2 intensity_scale;
+// cos/sin of i * PI / 4 - time * 0.1, computed once per frame on the CPU
+uniform vec2 circle_directions[8];
+
+#ifdef FUSED_TONEMAP
+// Same curve as colormapping.frag, used when compose writes the final image.
+vec3 tonemap(vec3 color) {
+    float exposure = 1.0;
+    return vec3(1.0) - exp(-color * exposure);
+}
+#endif
 
 void main() {
+#ifdef SENSES_OFF
+    // With zoom_amount == 0 everything below reduces to a copy of the scene.
+    vec3 color = texture(color_map, uv).rgb;
+#ifdef FUSED_TONEMAP
+    color = tonemap(color);
+#endif
+    frag_color = vec4(color, 1.0);
+#else
     // Another value which affect fisheye effect
     // but always set to vec2(1.0, 1.0).
     vec2 amount = vec2(1.0, 1.0);// cb0_v2.zw;
@@ -80,45 +99,34 @@ void main() {
     }
     vec3 color = texture(color_map, color_uv).rgb;
 
-    vec2 outline_uv = color_uv * 0.5;
-    float outline_interesting = texture(outline_map, outline_uv).x / 8.0;
-
-    outline_uv += vec2(0.5, 0.0);
-    float outline_traces = texture(outline_map, outline_uv).x / 8.0;
-
-    float timeParam = time * 0.1;
+    // Both classes come with one fetch, interesting in x and traces in y.
+    vec2 outlines = texture(outline_map, color_uv * outline_scale).xy / 8.0;
 
     circle_radius = 1.0 - circle_radius;
     circle_radius *= 0.03;
 
+    // The samples are averaged, dividing the sums once is exact because 8 is
+    // a power of two.
+    vec2 outlines_circle = vec2(0.0);
     vec3 color_circle_main = vec3(0.0, 0.0, 0.0);
     for (int i=0; 8 > i; i++)
     {
         // full 2*PI = 360 angles cycle
-        const float angleRadians = float(i) * PI_4 - timeParam;
-
-        vec2 unit_circle;
-        unit_circle.x = cos(angleRadians);
-        unit_circle.y = sin(angleRadians);
+        vec2 unit_circle = circle_directions[i] * circle_radius;
 
-        unit_circle *= circle_radius;
-
-        vec2 uv_outline_base = color_uv + unit_circle / 8.0;
-
-        vec2 uv_outline_interesting_circle = uv_outline_base * 0.5;
-        float outline_interesting_circle  = texture(outline_map, uv_outline_interesting_circle).x;
-        outline_interesting += outline_interesting_circle / 8.0;
-
-        vec2 uv_outline_traces_circle =  uv_outline_base * 0.5 + vec2(0.5, 0.0);
-        float outline_traces_circle  = texture(outline_map, uv_outline_traces_circle).x;
-        outline_traces += outline_traces_circle / 8.0;
+        vec2 uv_outline_circle = color_uv + unit_circle / 8.0;
+        outlines_circle += texture(outline_map, uv_outline_circle * outline_scale).xy;
 
         vec2 uv_color_circle  = color_uv + unit_circle * offset_uv;
-        vec3 color_circle = texture(color_map, uv_color_circle).rgb;
-        color_circle_main += color_circle / 8.0;
+        color_circle_main += texture(color_map, uv_color_circle).rgb;
     }
+    outlines += outlines_circle / 8.0;
+    color_circle_main /= 8.0;
+
+    float outline_interesting = outlines.x;
+    float outline_traces = outlines.y;
 
-    vec2 intensity = texture(intensity_map, color_uv).xy;
+    vec2 intensity = texture(intensity_map, color_uv * intensity_scale).xy;
 
     float intensity_interesting = intensity.r;
     float intensity_traces = intensity.g;
@@ -140,5 +148,9 @@ void main() {
     float dot_senses_total = clamp(dot(senses_total, vec3(1.0, 1.0, 1.0)), 0.0, 1.0) * zoom_amount;
 
     vec3 final_color = mix(main_color, senses_total_sat, dot_senses_total);
+#ifdef FUSED_TONEMAP
+    final_color = tonemap(final_color);
+#endif
     frag_color =  vec4(final_color, 1.0);
+#endif
 }
@@ -0,0 +1,7 @@
+#version 460 core
+
+// Depth pre-pass, see --depth-prepass. Depth and stencil are written by the
+// fixed function stages, so there is nothing to shade.
+
+void main() {
+}
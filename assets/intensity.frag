@@ -1,9 +1,59 @@
 #version 460 core
 
 layout(location = 0) out vec4 frag_color;
-uniform vec3 color;
+
+layout(std140, binding = 1) uniform Frame {
+    mat4 view;
+    mat4 proj;
+    mat4 inv_proj;
+    float time;
+} frame;
+
+uniform usampler2D stencil_map;
+uniform sampler2D depth_map;
+// Texels of the target to fill, the viewport the tiles are drawn into
+uniform ivec2 mask_size;
+// IntensityFalloff
+uniform int falloff;
+uniform float max_distance;
+
+float viewDistance(vec2 uv, float depth) {
+    vec4 view = frame.inv_proj * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return length(view.xyz / view.w);
+}
+
+float falloffWeight(float distance) {
+    if (distance > max_distance) {
+        return 0.0;
+    }
+    float x = distance / max_distance;
+    switch (falloff) {
+    case 1:
+        return 1.0 - x;
+    case 2:
+        return 1.0 - smoothstep(0.0, 1.0, x);
+    case 3: {
+        float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+        return window * window / (1.0 + 16.0 * x * x);
+    }
+    default:
+        return 1.0;
+    }
+}
 
 void main() {
-    // TODO: intensity should depend on distance to camera (player)
-    frag_color = vec4(color, 1.0);
+    vec2 screen_size = vec2(textureSize(depth_map, 0));
+    ivec2 pixel = ivec2(gl_FragCoord.xy * screen_size / vec2(mask_size));
+    uint stencil = texelFetch(stencil_map, pixel, 0).r;
+    // Interesting clues in r, traces in g
+    vec2 classes = vec2((stencil & 0x04u) != 0u, (stencil & 0x08u) != 0u);
+    if (classes == vec2(0.0)) {
+        frag_color = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    float depth = texelFetch(depth_map, pixel, 0).r;
+    vec2 uv = (vec2(pixel) + 0.5) / screen_size;
+    float weight = falloffWeight(viewDistance(uv, depth));
+    frag_color = vec4(classes * weight, 0.0, 1.0);
 }
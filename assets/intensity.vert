@@ -1,15 +1,31 @@
 #version 460 core
 
+// One quad per active screen tile, see intensity_tiles.comp.
+
+layout(std430, binding = 4) readonly buffer Tiles {
+    uint vertex_count;
+    uint instance_count;
+    uint first_vertex;
+    uint base_instance;
+    uint tiles[];
+};
+
+// Size of a tile in screen uv
+uniform vec2 tile_uv_size;
+
 void main() {
     vec2 positions[4] = vec2[](
-    vec2(-1.0, -1.0),
-    vec2(-1.0, 1.0),
+    vec2(0.0, 0.0),
+    vec2(0.0, 1.0),
     vec2(1.0, 1.0),
-    vec2(1.0, -1.0));
+    vec2(1.0, 0.0));
 
     int indices[6] = int[](
     0, 1, 2,
     2, 3, 0);
 
-    gl_Position = vec4(positions[indices[gl_VertexID]], 0.0, 1.0);
+    uint tile = tiles[gl_InstanceID];
+    vec2 origin = vec2(tile & 0xffffu, tile >> 16);
+    vec2 uv = (origin + positions[indices[gl_VertexID]]) * tile_uv_size;
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
 }
@@ -3,10 +3,9 @@
 layout(location = 0) in vec3 frag_pos;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 uv;
+layout(location = 3) flat in vec3 color;
 layout(location = 0) out vec4 frag_color;
 
-uniform vec3 color;
-
 layout(std140, binding = 0) uniform  DirectionalLight {
     vec3 direction;
     float intensity;
@@ -1,21 +1,63 @@
 #version 460 core
 
 layout(location = 0) in vec3 pos;
+#ifdef OCTAHEDRAL_NORMALS
+layout(location = 1) in vec2 octahedral_normal;
+#else
 layout(location = 1) in vec3 normal;
+#endif
 layout(location = 2) in vec2 uv;
 
 layout(location = 0) out vec3 o_frag_pos;
 layout(location = 1) out vec3 o_normal;
 layout(location = 2) out vec2 o_uv;
+layout(location = 3) flat out vec3 o_color;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+struct Instance {
+    mat4 model;
+    vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+// Indices of the instances that survived culling, per batch from its base
+// instance on.
+layout(std430, binding = 1) readonly buffer Visible {
+    uint visible[];
+};
+
+// The depth pre-pass and the colour pass must produce identical depth for
+// the GL_EQUAL test.
+invariant gl_Position;
+
+layout(std140, binding = 1) uniform Frame {
+    mat4 view;
+    mat4 proj;
+    mat4 inv_proj;
+    float time;
+} frame;
+
+#ifdef OCTAHEDRAL_NORMALS
+// Inverse of encodeOctahedral() in mesh_data.cpp
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+#endif
 
 void main() {
-    vec4 world_position = (model * vec4(pos, 1.0));
+#ifdef OCTAHEDRAL_NORMALS
+    vec3 normal = decodeOctahedral(octahedral_normal);
+#endif
+    Instance instance = instances[visible[gl_BaseInstance + gl_InstanceID]];
+    vec4 world_position = (instance.model * vec4(pos, 1.0));
     o_frag_pos = world_position.xyz;
     o_normal = normal;
     o_uv = uv;
-    gl_Position = proj * view * world_position;
+    o_color = instance.color.rgb;
+    gl_Position = frame.proj * frame.view * world_position;
 }
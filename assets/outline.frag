@@ -3,9 +3,74 @@
 layout(location = 0) in vec2 uv;
 layout(location = 0) out vec4 frag_color;
 
-uniform float time;
+layout(std140, binding = 1) uniform Frame {
+    mat4 view;
+    mat4 proj;
+    mat4 inv_proj;
+    float time;
+} frame;
 uniform sampler2D intensity_map;
 uniform sampler2D outline_map;
+// Size of one outline texel in uv of the active region
+uniform vec2 outline_texel_size;
+// Parts of intensity_map and outline_map in use, see setOutlineScale()
+uniform vec2 intensity_scale;
+uniform vec2 history_scale;
+uniform sampler2D depth_map;
+// Reads the history where the camera saw each texel, see setOutlineCamera()
+uniform int reproject;
+uniform mat4 inv_view_proj;
+uniform mat4 history_view_proj;
+
+// The mask is sampled twice across the outline, as with repeat wrapping but
+// confined to the active part of the intensity texture.
+vec4 sampleIntensity(vec2 texture_uv) {
+    return texture(intensity_map, fract(texture_uv) * intensity_scale);
+}
+
+// Blue of the outline holds the view depth of the screen pixel each texel
+// was computed for. A reprojected history sample whose depth differs more
+// than this fraction from the one expected was hidden in the previous frame.
+#define DISOCCLUSION_THRESHOLD 0.1
+
+float viewDepth(vec2 screen_uv, float depth) {
+    vec4 view = frame.inv_proj * vec4(vec3(screen_uv, depth) * 2.0 - 1.0, 1.0);
+    return -view.z / view.w;
+}
+
+// Each quadrant of the outline covers the whole screen.
+vec2 getQuadrant(vec2 texel_uv) {
+    return min(floor(texel_uv * 2.0), vec2(1.0));
+}
+
+float getTexelDepth(vec2 texel_uv) {
+    vec2 screen_uv = texel_uv * 2.0 - getQuadrant(texel_uv);
+    return viewDepth(screen_uv, texture(depth_map, screen_uv).r);
+}
+
+// Previous state of the texel at `texel_uv` of the active region, read
+// where the history camera saw the same point. Points that were off screen
+// or hidden start over at zero.
+vec2 sampleHistory(vec2 texel_uv) {
+    if (reproject == 0) {
+        return texture(outline_map, texel_uv * history_scale).xy;
+    }
+    vec2 quadrant = getQuadrant(texel_uv);
+    vec2 screen_uv = texel_uv * 2.0 - quadrant;
+    float depth = texture(depth_map, screen_uv).r;
+    vec4 world = inv_view_proj * vec4(vec3(screen_uv, depth) * 2.0 - 1.0, 1.0);
+    vec4 previous = history_view_proj * (world / world.w);
+    vec2 previous_uv = previous.xy / previous.w * 0.5 + 0.5;
+    if (any(lessThan(previous_uv, vec2(0.0))) || any(greaterThan(previous_uv, vec2(1.0)))) {
+        return vec2(0.0);
+    }
+    vec3 history = texture(outline_map, (quadrant + previous_uv) * 0.5 * history_scale).xyz;
+    // Clip space w of a perspective projection is the view depth.
+    if (abs(history.z - previous.w) > DISOCCLUSION_THRESHOLD * previous.w) {
+        return vec2(0.0);
+    }
+    return history.xy;
+}
 
 float getParams(vec2 uv) {
     float d = dot(uv, uv);
@@ -36,50 +101,51 @@ void main() {
     mask.z = getParams(uv3);
     mask.w = getParams(uv4);
 
-    vec4 intensity = texture(intensity_map, texture_uv);
+    vec4 intensity = sampleIntensity(texture_uv);
     float master_filter = dot(intensity, mask);
 
-    float texel_size = 1.0/256.0;
-    vec2 sampling1 = texture_uv + vec2(texel_size, 0.0);
-    vec2 sampling2 = texture_uv + vec2(-texel_size, 0.0);
-    vec2 sampling3 = texture_uv + vec2(0.0, texel_size);
-    vec2 sampling4 = texture_uv + vec2(0.0, -texel_size);
+    // One outline texel in the doubled coordinates
+    vec2 texel_size = 2.0 * outline_texel_size;
+    vec2 sampling1 = texture_uv + vec2(texel_size.x, 0.0);
+    vec2 sampling2 = texture_uv + vec2(-texel_size.x, 0.0);
+    vec2 sampling3 = texture_uv + vec2(0.0, texel_size.y);
+    vec2 sampling4 = texture_uv + vec2(0.0, -texel_size.y);
 
-    vec2 intensity_x0 = texture(intensity_map, sampling1).xy;
-    vec2 intensity_x1 = texture(intensity_map, sampling2).xy;
+    vec2 intensity_x0 = sampleIntensity(sampling1).xy;
+    vec2 intensity_x1 = sampleIntensity(sampling2).xy;
     vec2 intensity_diff_x = intensity_x0 - intensity_x1;
 
-    vec2 intensity_y0 = texture(intensity_map, sampling3).xy;
-    vec2 intensity_y1 = texture(intensity_map, sampling4).xy;
+    vec2 intensity_y0 = sampleIntensity(sampling3).xy;
+    vec2 intensity_y1 = sampleIntensity(sampling4).xy;
     vec2 intensity_diff_y = intensity_y0 - intensity_y1;
 
     vec2 max_abs_difference = max(abs(intensity_diff_x), abs(intensity_diff_y));
     max_abs_difference = clamp(max_abs_difference, 0.0, 1.0);
 
     vec2 outlines = master_filter * max_abs_difference;
-    vec2 last_outlines = texture(outline_map, uv).xy;
+    vec2 last_outlines = sampleHistory(uv);
 
     float param_outline = master_filter * 0.15 + last_outlines.y;
     param_outline += 0.35 * outlines.r;
     param_outline += 0.35 * outlines.g;
 
-    vec2 noise_weights = vec2(time, 0.0);
+    vec2 noise_weights = vec2(frame.time, 0.0);
     vec2 noise_inputs = 150.0 * uv + 300.0 * noise_weights;
     ivec2 i_noise_inputs = ivec2(noise_inputs);
 
     float noise0 = clamp(integerNoise(i_noise_inputs.x + bitfieldReverse(i_noise_inputs.y)), -1, 1) + 0.65;// r0.y
 
-    texel_size = 1.0 / 512.0;
+    texel_size = outline_texel_size;
 
-    sampling1 = clamp(uv + vec2(texel_size, 0.0), 0.0, 1.0);
-    sampling2 = clamp(uv + vec2(-texel_size, 0.0), 0.0, 1.0);
-    sampling3 = clamp(uv + vec2(0.0, texel_size), 0.0, 1.0);
-    sampling4 = clamp(uv + vec2(0.0, -texel_size), 0.0, 1.0);
+    sampling1 = clamp(uv + vec2(texel_size.x, 0.0), 0.0, 1.0);
+    sampling2 = clamp(uv + vec2(-texel_size.x, 0.0), 0.0, 1.0);
+    sampling3 = clamp(uv + vec2(0.0, texel_size.y), 0.0, 1.0);
+    sampling4 = clamp(uv + vec2(0.0, -texel_size.y), 0.0, 1.0);
 
-    float outline_x0 = texture(outline_map, sampling1).x;
-    float outline_x1 = texture(outline_map, sampling2).x;
-    float outline_y0 = texture(outline_map, sampling3).x;
-    float outline_y1 = texture(outline_map, sampling4).x;
+    float outline_x0 = sampleHistory(sampling1).x;
+    float outline_x1 = sampleHistory(sampling2).x;
+    float outline_y0 = sampleHistory(sampling3).x;
+    float outline_y1 = sampleHistory(sampling4).x;
     float average_outline = (outline_x0 + outline_x1 + outline_y0 + outline_y1) / 4.0;
 
     float frame_outline_difference = average_outline - last_outlines.x;
@@ -96,5 +162,5 @@ void main() {
     damping_param = pow(damping_param, 100);
     float damping = 0.7 + 0.16 * damping_param;
 
-    frag_color = vec4(final_outline * damping, 0.0, 1.0);
+    frag_color = vec4(final_outline * damping, getTexelDepth(uv), 1.0);
 }
@@ -0,0 +1,79 @@
+#include "asset_manager.h"
+
+#include <cstring>
+#include <iostream>
+
+AssetManager::AssetManager(ThreadPool &pool, VertexLayout layout,
+                           std::size_t staging_size)
+    : pool_{pool}, layout_{layout}, staging_{staging_size},
+      queue_{std::make_shared<Queue>()} {}
+
+MeshHandle AssetManager::loadMesh(const std::string &path) {
+  if (auto it = meshes_.find(path); it != meshes_.end()) {
+    return it->second;
+  }
+
+  auto mesh = std::make_shared<Mesh>();
+  meshes_.emplace(path, mesh);
+  ++pending_;
+
+  pool_.submit([queue = queue_, path, mesh, layout = layout_] {
+    auto data = loadMeshData(path.c_str(), layout);
+    std::lock_guard lock(queue->mutex);
+    queue->decoded.push_back({path, mesh, std::move(data)});
+  });
+
+  return mesh;
+}
+
+void AssetManager::update() {
+  {
+    std::lock_guard lock(queue_->mutex);
+    for (auto &decoded : queue_->decoded) {
+      waiting_.push_back(std::move(decoded));
+    }
+    queue_->decoded.clear();
+  }
+
+  std::size_t uploaded = 0;
+  for (; uploaded < waiting_.size(); ++uploaded) {
+    auto &decoded = waiting_[uploaded];
+    if (!decoded.data) {
+      std::cerr << "Unable to load: " << decoded.path << '\n';
+    } else if (!uploadStaged(*decoded.mesh, *decoded.data)) {
+      const std::size_t bytes = decoded.data->getVertices().size_bytes() +
+                                decoded.data->getIndices().size_bytes();
+      if (bytes + 64 <= staging_.getSize()) {
+        // The staging ring is full, retry once earlier uploads have retired.
+        break;
+      }
+      decoded.mesh->upload(*decoded.data);
+    }
+    --pending_;
+  }
+  waiting_.erase(waiting_.begin(), waiting_.begin() + std::ptrdiff_t(uploaded));
+  staging_.endFrame();
+}
+
+uint32_t AssetManager::getPendingCount() const { return pending_; }
+
+bool AssetManager::uploadStaged(Mesh &mesh, const MeshData &data) {
+  const auto vertices = data.getVertices();
+  const auto indices = data.getIndices();
+
+  const auto vertex_offset = staging_.allocate(vertices.size_bytes());
+  if (!vertex_offset) {
+    return false;
+  }
+  const auto index_offset = staging_.allocate(indices.size_bytes());
+  if (!index_offset) {
+    return false;
+  }
+
+  std::memcpy(staging_.getPointer(*vertex_offset), vertices.data(),
+              vertices.size_bytes());
+  std::memcpy(staging_.getPointer(*index_offset), indices.data(),
+              indices.size_bytes());
+  mesh.copy(staging_.getBuffer(), *vertex_offset, *index_offset, data);
+  return true;
+}
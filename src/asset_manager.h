@@ -0,0 +1,55 @@
+#pragma once
+
+#include "components.h"
+#include "staging_buffer.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Loads meshes on the thread pool. loadMesh() returns immediately with a
+// handle whose mesh stays empty (Mesh::isReady() == false) until update()
+// has uploaded the decoded data on the GL thread. Every mesh is loaded in
+// `layout`.
+class AssetManager {
+public:
+  explicit AssetManager(ThreadPool &pool,
+                        VertexLayout layout = VertexLayout::Full,
+                        std::size_t staging_size = 16 * 1024 * 1024);
+
+  MeshHandle loadMesh(const std::string &path);
+
+  // Uploads finished meshes. Must be called on the thread owning the GL
+  // context.
+  void update();
+
+  uint32_t getPendingCount() const;
+
+private:
+  struct Decoded {
+    std::string path;
+    MeshHandle mesh;
+    std::optional<MeshData> data;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::vector<Decoded> decoded;
+  };
+
+  bool uploadStaged(Mesh &mesh, const MeshData &data);
+
+  ThreadPool &pool_;
+  VertexLayout layout_;
+  StagingBuffer staging_;
+  std::shared_ptr<Queue> queue_;
+  std::unordered_map<std::string, MeshHandle> meshes_{};
+  std::vector<Decoded> waiting_{};
+  uint32_t pending_{0};
+};
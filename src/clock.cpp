@@ -0,0 +1,24 @@
+#include "clock.h"
+
+#include <cmath>
+
+Clock::Duration RealClock::advance() {
+  const TimePoint now = std::chrono::steady_clock::now();
+  if (!started_) {
+    started_ = true;
+    last_ = now;
+    return Duration::zero();
+  }
+  const Duration elapsed =
+      std::chrono::duration_cast<Duration>(now - last_);
+  last_ = now;
+  return elapsed;
+}
+
+DeterministicClock::DeterministicClock(Duration step) : step_(step) {}
+
+Clock::Duration DeterministicClock::advance() { return step_; }
+
+Clock::Duration toDuration(double seconds) {
+  return Clock::Duration(std::llround(seconds * 1.0e9));
+}
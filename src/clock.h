@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+
+// Source of frame time for the scheduler.
+class Clock {
+public:
+  using Duration = std::chrono::nanoseconds;
+
+  virtual ~Clock() = default;
+
+  // Time passed since the previous call, zero on the first call.
+  virtual Duration advance() = 0;
+};
+
+// Wall-clock time.
+class RealClock final : public Clock {
+public:
+  Duration advance() override;
+
+private:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  TimePoint last_{};
+  bool started_{false};
+};
+
+// Advances by the same step every frame, for tests and benchmarks.
+class DeterministicClock final : public Clock {
+public:
+  explicit DeterministicClock(Duration step);
+
+  Duration advance() override;
+
+private:
+  Duration step_;
+};
+
+// Converts seconds to a clock duration, rounded to whole nanoseconds.
+Clock::Duration toDuration(double seconds);
@@ -0,0 +1,85 @@
+#include "clue_system.h"
+
+#include "camera.h"
+
+namespace {
+
+bool isClue(const World &world, entt::entity entity) {
+  return world.any_of<Trace, Interesting>(entity);
+}
+
+void markClueDirty(World &world, entt::entity entity) {
+  if (world.all_of<Transform>(entity)) {
+    world.emplace_or_replace<TransformDirty>(entity);
+  }
+}
+
+// Runs before the component is removed, so the entity stays a clue when it
+// still has the other tag.
+template <typename Other>
+void removeClueTag(World &world, entt::entity entity) {
+  if (!world.all_of<Other>(entity)) {
+    world.ctx().at<ClueIndex>().getGrid().remove(entity);
+  }
+}
+
+void removeClue(World &world, entt::entity entity) {
+  world.ctx().at<ClueIndex>().getGrid().remove(entity);
+}
+
+} // namespace
+
+ClueIndex::ClueIndex(float cell_size) : grid_{cell_size} {}
+
+SpatialGrid &ClueIndex::getGrid() { return grid_; }
+
+const SpatialGrid &ClueIndex::getGrid() const { return grid_; }
+
+void ClueIndex::query(const glm::vec3 &center, float radius) {
+  ++query_;
+  in_range_.clear();
+  grid_.query(center, radius, in_range_);
+  for (auto entity : in_range_) {
+    const auto index = std::size_t(entt::to_entity(entity));
+    if (index >= stamps_.size()) {
+      stamps_.resize(index + 1, 0);
+    }
+    stamps_[index] = query_;
+  }
+}
+
+bool ClueIndex::isInRange(entt::entity entity) const {
+  const auto index = std::size_t(entt::to_entity(entity));
+  return index < stamps_.size() && stamps_[index] == query_;
+}
+
+std::size_t ClueIndex::getInRangeCount() const { return in_range_.size(); }
+
+void registerClueTracking(World &world, float cell_size) {
+  world.ctx().emplace<ClueIndex>(cell_size);
+  world.on_construct<Trace>().connect<&markClueDirty>();
+  world.on_construct<Interesting>().connect<&markClueDirty>();
+  world.on_destroy<Trace>().connect<&removeClueTag<Interesting>>();
+  world.on_destroy<Interesting>().connect<&removeClueTag<Trace>>();
+  world.on_destroy<Transform>().connect<&removeClue>();
+}
+
+void updateClueIndex(World &world) {
+  auto &grid = world.ctx().at<ClueIndex>().getGrid();
+  for (auto [entity, transform] :
+       world.view<const Transform, const TransformDirty>().each()) {
+    if (isClue(world, entity)) {
+      grid.update(entity, transform.translation);
+    }
+  }
+}
+
+void querySenseRange(World &world) {
+  const float radius = world.ctx().at<const Senses>().radius;
+  auto &clues = world.ctx().at<ClueIndex>();
+  // The scene has a single camera, the player.
+  for (auto [entity, world_matrix] :
+       world.view<const WorldMatrix, const Camera>().each()) {
+    clues.query(glm::vec3(world_matrix.matrix[3]), radius);
+  }
+}
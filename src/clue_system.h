@@ -0,0 +1,39 @@
+#pragma once
+
+#include "components.h"
+#include "spatial_grid.h"
+
+#include <cstdint>
+#include <vector>
+
+// Trace and Interesting entities indexed by position, and the ones the
+// last querySenseRange() found around the camera.
+class ClueIndex {
+public:
+  explicit ClueIndex(float cell_size);
+
+  SpatialGrid &getGrid();
+  const SpatialGrid &getGrid() const;
+
+  // Replaces the in-range set with the clues within `radius` of `center`.
+  void query(const glm::vec3 &center, float radius);
+  bool isInRange(entt::entity entity) const;
+  std::size_t getInRangeCount() const;
+
+private:
+  SpatialGrid grid_;
+  std::vector<entt::entity> in_range_{};
+  // Per entity index, equal to query_ when in range
+  std::vector<uint32_t> stamps_{};
+  uint32_t query_{0};
+};
+
+// Keeps the ClueIndex in sync with Trace, Interesting and Transform.
+// Transforms have to be changed through World::patch/replace, like for
+// updateWorldMatrices().
+void registerClueTracking(World &world, float cell_size);
+// Moves the clues whose Transform changed, has to run before
+// updateWorldMatrices() clears TransformDirty.
+void updateClueIndex(World &world);
+// Finds the clues within Senses::radius of the camera.
+void querySenseRange(World &world);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <memory>
+
+struct Transform {
+  glm::vec3 translation{};
+  glm::vec3 rotation{};
+  glm::vec3 scale{1.0f};
+
+  Transform() = default;
+  Transform(const Transform &) = default;
+
+  explicit Transform(const glm::vec3 &translation) : translation{translation} {}
+
+  glm::mat4 transform() const {
+    glm::mat4 rotation_matrix = glm::toMat4(glm::quat(rotation));
+
+    return glm::translate(glm::mat4(1.0f), translation) * rotation_matrix *
+           glm::scale(glm::mat4(1.0f), scale);
+  }
+};
+
+// Cached result of Transform::transform(), see transform_system.h.
+struct WorldMatrix {
+  glm::mat4 matrix{1.0f};
+};
+
+// Marks entities whose Transform was created or patched since the last
+// updateWorldMatrices().
+struct TransformDirty {};
+
+struct Color {
+  glm::vec3 color;
+};
+
+using MeshHandle = std::shared_ptr<Mesh>;
+using World = entt::registry;
+
+struct Move {};
+struct Trace {};
+struct Interesting {};
+
+struct Input {
+  bool initialized{false};
+  float horizontal{};
+  float vertical{};
+  bool senses{false};
+  // Toggled with O, the renderer picks it up with the next frame packet
+  bool outline_compute{false};
+  glm::vec2 mouse_pos{};
+  glm::vec2 mouse_delta{};
+  bool left_mouse{};
+  bool right_mouse{};
+};
+
+struct Senses {
+  float amount{0.0f};
+  // Only clues within this distance of the camera are tagged
+  float radius{20.0f};
+};
+
+// Entities moved by fixed-step systems. They are drawn between their last
+// two steps, see storePreviousTranslations().
+struct Interpolated {
+  glm::vec3 previous_translation{};
+  bool moving{false};
+};
+
+// Simulation time, advanced by the Scheduler.
+struct Time {
+  // Time of the current simulation step
+  double elapsed{0.0};
+  // Length of one step in seconds
+  float dt{0.0f};
+  // Fraction of a step between the current step and the frame time
+  float alpha{0.0f};
+  uint64_t steps{0};
+
+  // Time the interpolated render state corresponds to, one step behind.
+  double renderTime() const { return elapsed - double(dt) * (1.0 - alpha); }
+};
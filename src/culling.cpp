@@ -0,0 +1,102 @@
+#include "culling.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define WITCHER_SENSES_SSE
+#endif
+
+std::optional<CullingMode> parseCullingMode(const std::string &name) {
+  if (name == "off") {
+    return CullingMode::Off;
+  }
+  if (name == "cpu") {
+    return CullingMode::Cpu;
+  }
+  if (name == "gpu") {
+    return CullingMode::Gpu;
+  }
+  return std::nullopt;
+}
+
+const char *getCullingModeName(CullingMode mode) {
+  switch (mode) {
+  case CullingMode::Off:
+    return "off";
+  case CullingMode::Cpu:
+    return "cpu";
+  case CullingMode::Gpu:
+    return "gpu";
+  }
+  return "unknown";
+}
+
+FrustumPlanes extractFrustumPlanes(const glm::mat4 &view_projection) {
+  const auto row = [&](int i) {
+    return glm::vec4(view_projection[0][i], view_projection[1][i],
+                     view_projection[2][i], view_projection[3][i]);
+  };
+  const glm::vec4 x = row(0);
+  const glm::vec4 y = row(1);
+  const glm::vec4 z = row(2);
+  const glm::vec4 w = row(3);
+
+  FrustumPlanes planes = {w + x, w - x, w + y, w - y, w + z, w - z};
+  for (auto &plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return planes;
+}
+
+void PackedSpheres::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+}
+
+void PackedSpheres::push(const glm::vec3 &center, float sphere_radius) {
+  x.push_back(center.x);
+  y.push_back(center.y);
+  z.push_back(center.z);
+  radius.push_back(sphere_radius);
+}
+
+std::size_t PackedSpheres::size() const { return x.size(); }
+
+void cullSpheres(const FrustumPlanes &planes, const PackedSpheres &spheres,
+                 uint8_t *visible) {
+  const std::size_t count = spheres.size();
+  std::size_t i = 0;
+
+#ifdef WITCHER_SENSES_SSE
+  for (; i + 4 <= count; i += 4) {
+    const __m128 x = _mm_loadu_ps(spheres.x.data() + i);
+    const __m128 y = _mm_loadu_ps(spheres.y.data() + i);
+    const __m128 z = _mm_loadu_ps(spheres.z.data() + i);
+    const __m128 negative_radius =
+        _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + i));
+
+    int mask = 0xf;
+    for (const auto &plane : planes) {
+      __m128 distance = _mm_mul_ps(x, _mm_set1_ps(plane.x));
+      distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+      distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+      distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+      mask &= _mm_movemask_ps(_mm_cmpge_ps(distance, negative_radius));
+    }
+    for (int lane = 0; lane < 4; ++lane) {
+      visible[i + lane] = uint8_t((mask >> lane) & 1);
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    bool inside = true;
+    for (const auto &plane : planes) {
+      const float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] +
+                             plane.z * spheres.z[i] + plane.w;
+      inside = inside && distance >= -spheres.radius[i];
+    }
+    visible[i] = uint8_t(inside);
+  }
+}
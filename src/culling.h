@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class CullingMode {
+  Off,
+  Cpu,
+  Gpu,
+};
+
+std::optional<CullingMode> parseCullingMode(const std::string &name);
+const char *getCullingModeName(CullingMode mode);
+
+// Frustum planes as (normal, distance) with normals pointing inwards, in the
+// order left, right, bottom, top, near, far.
+using FrustumPlanes = std::array<glm::vec4, 6>;
+
+FrustumPlanes extractFrustumPlanes(const glm::mat4 &view_projection);
+
+// World space bounding spheres packed as structure of arrays for cullSpheres.
+struct PackedSpheres {
+  std::vector<float> x, y, z, radius;
+
+  void clear();
+  void push(const glm::vec3 &center, float sphere_radius);
+  std::size_t size() const;
+};
+
+// Writes 1 to `visible[i]` when sphere i intersects the frustum and 0
+// otherwise. Same test as assets/cull.comp, four spheres at a time.
+void cullSpheres(const FrustumPlanes &planes, const PackedSpheres &spheres,
+                 uint8_t *visible);
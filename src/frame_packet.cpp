@@ -0,0 +1,91 @@
+#include "frame_packet.h"
+
+#include "camera.h"
+#include "clue_system.h"
+
+#include <algorithm>
+
+void buildFramePacket(World &world, entt::entity camera, FramePacket &packet) {
+  const auto &camera_component = world.get<const Camera>(camera);
+  packet.view = camera_component.getView();
+  packet.proj = camera_component.getProjection();
+  packet.time = world.ctx().at<const Time>().renderTime();
+  packet.senses = world.ctx().at<const Senses>().amount;
+  packet.outline_mode = world.ctx().at<const Input>().outline_compute
+                            ? OutlineMode::Compute
+                            : OutlineMode::Fragment;
+
+  const glm::vec3 eye = glm::inverse(packet.view)[3];
+  auto &items = packet.items;
+  items.clear();
+  const auto &clues = world.ctx().at<const ClueIndex>();
+  auto traces = world.view<Trace>();
+  auto interesting = world.view<Interesting>();
+  auto view = world.view<const WorldMatrix, const MeshHandle, const Color>();
+  view.each([&](auto entity, const auto &world_matrix, const auto &mesh,
+                const auto &color) {
+    // Clues outside the sense radius are drawn untagged.
+    StencilClass stencil = StencilClass::None;
+    if (clues.isInRange(entity)) {
+      if (traces.contains(entity)) {
+        stencil = StencilClass::Trace;
+      } else if (interesting.contains(entity)) {
+        stencil = StencilClass::Interesting;
+      }
+    }
+    const glm::vec3 offset = glm::vec3(world_matrix.matrix[3]) - eye;
+    items.push_back({entity, stencil, mesh.get(), glm::dot(offset, offset),
+                     world_matrix.matrix, glm::vec4(color.color, 1.0f)});
+  });
+
+  std::sort(items.begin(), items.end(),
+            [](const DrawItem &lhs, const DrawItem &rhs) {
+              if (lhs.stencil != rhs.stencil) {
+                return lhs.stencil < rhs.stencil;
+              }
+              if (lhs.mesh != rhs.mesh) {
+                return std::less<>{}(lhs.mesh, rhs.mesh);
+              }
+              return lhs.distance < rhs.distance;
+            });
+}
+
+FramePacket &FramePacketQueue::beginWrite() {
+  std::unique_lock lock(mutex_);
+  condition_.wait(lock, [this] { return written_ < packets_.size(); });
+  return packets_[(read_index_ + written_) % packets_.size()];
+}
+
+void FramePacketQueue::endWrite() {
+  {
+    std::lock_guard lock(mutex_);
+    ++written_;
+  }
+  condition_.notify_all();
+}
+
+const FramePacket *FramePacketQueue::beginRead() {
+  std::unique_lock lock(mutex_);
+  condition_.wait(lock, [this] { return closed_ || written_ != 0; });
+  if (written_ == 0) {
+    return nullptr;
+  }
+  return &packets_[read_index_];
+}
+
+void FramePacketQueue::endRead() {
+  {
+    std::lock_guard lock(mutex_);
+    read_index_ = (read_index_ + 1) % packets_.size();
+    --written_;
+  }
+  condition_.notify_all();
+}
+
+void FramePacketQueue::close() {
+  {
+    std::lock_guard lock(mutex_);
+    closed_ = true;
+  }
+  condition_.notify_all();
+}
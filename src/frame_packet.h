@@ -0,0 +1,74 @@
+#pragma once
+
+#include "components.h"
+#include "mesh.h"
+#include "outline.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class StencilClass : uint8_t {
+  None,
+  Interesting,
+  Trace,
+};
+
+struct DrawItem {
+  // Keys per-instance state kept by the renderer, like the current LOD
+  entt::entity entity;
+  StencilClass stencil;
+  // Not necessarily uploaded yet, the renderer skips meshes that are not
+  // ready.
+  Mesh *mesh;
+  // Squared distance to the camera
+  float distance;
+  glm::mat4 model;
+  glm::vec4 color;
+};
+
+// Everything the renderer needs from the simulation for one frame. Written
+// by the simulation thread, then only read by the render thread.
+struct FramePacket {
+  glm::mat4 view{1.0f};
+  glm::mat4 proj{1.0f};
+  // Time::renderTime() of the frame
+  double time{0.0};
+  float senses{0.0f};
+  OutlineMode outline_mode{OutlineMode::Fragment};
+  // Sorted by stencil class, mesh and distance to the camera
+  std::vector<DrawItem> items{};
+};
+
+// Fills the packet from the interpolated state of the world.
+void buildFramePacket(World &world, entt::entity camera, FramePacket &packet);
+
+// Two packets handed from the simulation to the render thread, so the
+// simulation of one frame overlaps the submission of the previous one.
+// The writer blocks while the reader still holds both packets.
+class FramePacketQueue {
+public:
+  FramePacket &beginWrite();
+  void endWrite();
+
+  // Blocks until a packet is written, nullptr once the queue is closed and
+  // every written packet was read.
+  const FramePacket *beginRead();
+  void endRead();
+
+  void close();
+
+private:
+  std::array<FramePacket, 2> packets_{};
+  // Oldest packet that was written and not yet released by the reader
+  std::size_t read_index_{0};
+  std::size_t written_{0};
+  bool closed_{false};
+  std::mutex mutex_{};
+  std::condition_variable condition_{};
+};
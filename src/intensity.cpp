@@ -0,0 +1,236 @@
+#include "intensity.h"
+#include "outline.h"
+#include "state_cache.h"
+
+#include <utility>
+
+namespace {
+
+constexpr int MASK_TILE_SIZE = 16;
+// Screen tiles classified by intensity_tiles.comp
+constexpr int SCREEN_TILE_SIZE = 16;
+constexpr GLuint TILE_BUFFER_BINDING = 4;
+
+constexpr Uniform<int, "stencil_map"> STENCIL_MAP;
+constexpr Uniform<int, "depth_map"> DEPTH_MAP;
+constexpr Uniform<int, "tile_map"> TILE_MAP;
+constexpr Uniform<glm::ivec2, "mask_size"> MASK_SIZE;
+constexpr Uniform<glm::vec2, "tile_uv_size"> TILE_UV_SIZE;
+constexpr Uniform<int, "falloff"> FALLOFF;
+constexpr Uniform<float, "max_distance"> MAX_DISTANCE;
+constexpr int MIN_MASK_SIZE = 64;
+
+// DrawArraysIndirectCommand at the start of the tile buffer
+struct TileDrawCommand {
+  uint32_t count;
+  uint32_t instance_count;
+  uint32_t first;
+  uint32_t base_instance;
+};
+
+glm::ivec2 getTileCount(glm::ivec2 screen_size) {
+  return (screen_size + (SCREEN_TILE_SIZE - 1)) / SCREEN_TILE_SIZE;
+}
+
+gl::texture_2d createTileMap(glm::ivec2 tiles) {
+  gl::texture_2d texture;
+  texture.set_min_filter(GL_NEAREST);
+  texture.set_mag_filter(GL_NEAREST);
+  texture.set_storage(1, GL_R32F, tiles.x, tiles.y);
+  return texture;
+}
+
+gl::buffer createTileBuffer(glm::ivec2 tiles) {
+  gl::buffer buffer;
+  buffer.set_data(sizeof(TileDrawCommand) +
+                      sizeof(uint32_t) * std::size_t(tiles.x * tiles.y),
+                  nullptr);
+  return buffer;
+}
+
+// Writes the nearest in-range tagged distance of every screen tile to
+// tile_map and appends the active tiles to tile_buffer.
+void classifyTiles(Intensity &intensity) {
+  const TileDrawCommand command{6, 0, 0, 0};
+  glNamedBufferSubData(intensity.tile_buffer.id(), 0, sizeof(command),
+                       &command);
+
+  intensity.tile_shader.use();
+  intensity.stencil_view.bind_unit(0);
+  intensity.depth_view.bind_unit(1);
+  glBindImageTexture(0, intensity.tile_map.id(), 0, GL_FALSE, 0,
+                     GL_WRITE_ONLY, GL_R32F);
+  intensity.tile_buffer.bind_base(GL_SHADER_STORAGE_BUFFER,
+                                  TILE_BUFFER_BINDING);
+  const glm::ivec2 tiles = getTileCount(intensity.screen_size);
+  glDispatchCompute(GLuint(tiles.x), GLuint(tiles.y), 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+                  GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void drawStencilClasses(Intensity &intensity) {
+  intensity.framebuffer.bind();
+  gl::set_viewport({0, 0}, {intensity.size.x, intensity.size.y});
+  gl::set_clear_color({0.0, 0.0, 0.0, 1.0});
+  gl::clear(GL_COLOR_BUFFER_BIT);
+  intensity.shader.use();
+  intensity.shader.set(MASK_SIZE, intensity.size);
+  auto &state = StateCache::get();
+  intensity.stencil_view.bind_unit(0);
+  intensity.depth_view.bind_unit(1);
+  state.bindVertexArray(intensity.vao.id());
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, intensity.tile_buffer.id());
+  glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void buildStencilMask(Intensity &intensity) {
+  intensity.shader.use();
+  intensity.shader.set(MASK_SIZE, intensity.size);
+  intensity.stencil_view.bind_unit(0);
+  intensity.depth_view.bind_unit(1);
+  StateCache::get().bindTextureUnit(2, intensity.tile_map.id());
+  glBindImageTexture(0, intensity.color.id(), 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                     GL_RG8);
+  const glm::uvec2 groups =
+      (glm::uvec2(intensity.size) + GLuint(MASK_TILE_SIZE - 1)) /
+      GLuint(MASK_TILE_SIZE);
+  glDispatchCompute(groups.x, groups.y, 1);
+}
+
+} // namespace
+
+std::optional<IntensityFalloff> parseIntensityFalloff(const std::string &name) {
+  if (name == "constant") {
+    return IntensityFalloff::Constant;
+  }
+  if (name == "linear") {
+    return IntensityFalloff::Linear;
+  }
+  if (name == "smooth") {
+    return IntensityFalloff::Smooth;
+  }
+  if (name == "inverse-square") {
+    return IntensityFalloff::InverseSquare;
+  }
+  return std::nullopt;
+}
+
+const char *getIntensityFalloffName(IntensityFalloff falloff) {
+  switch (falloff) {
+  case IntensityFalloff::Constant:
+    return "constant";
+  case IntensityFalloff::Linear:
+    return "linear";
+  case IntensityFalloff::Smooth:
+    return "smooth";
+  case IntensityFalloff::InverseSquare:
+    return "inverse-square";
+  }
+  return "unknown";
+}
+
+DepthStencilView::DepthStencilView(const gl::texture_2d &depth_stencil,
+                                   GLenum mode) {
+  glGenTextures(1, &id_);
+  glTextureView(id_, GL_TEXTURE_2D, depth_stencil.id(), GL_DEPTH24_STENCIL8,
+                0, 1, 0, 1);
+  glTextureParameteri(id_, GL_DEPTH_STENCIL_TEXTURE_MODE, GLint(mode));
+  glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+DepthStencilView::~DepthStencilView() {
+  if (id_ != 0) {
+    glDeleteTextures(1, &id_);
+  }
+}
+
+DepthStencilView::DepthStencilView(DepthStencilView &&other) noexcept
+    : id_{std::exchange(other.id_, 0)} {}
+
+DepthStencilView &
+DepthStencilView::operator=(DepthStencilView &&other) noexcept {
+  std::swap(id_, other.id_);
+  return *this;
+}
+
+void DepthStencilView::bind_unit(GLuint unit) const {
+  StateCache::get().bindTextureUnit(unit, id_);
+}
+
+TextureDesc getIntensityTextureDesc(IntensityMode mode, int width,
+                                    int height) {
+  if (mode == IntensityMode::StencilMask) {
+    return {OUTLINE_SIZE, OUTLINE_SIZE, GL_RG8};
+  }
+  return {width, height, GL_R11F_G11F_B10F};
+}
+
+void createIntensity(World &world, IntensityMode mode,
+                     const gl::texture_2d &depth_stencil,
+                     const gl::texture_2d &color, IntensityFalloff falloff,
+                     float max_distance, ProgramRegistry &programs) {
+  gl::framebuffer framebuffer;
+  glm::ivec2 size;
+  glGetTextureLevelParameteriv(color.id(), 0, GL_TEXTURE_WIDTH, &size.x);
+  glGetTextureLevelParameteriv(color.id(), 0, GL_TEXTURE_HEIGHT, &size.y);
+  glm::ivec2 screen_size;
+  glGetTextureLevelParameteriv(depth_stencil.id(), 0, GL_TEXTURE_WIDTH,
+                               &screen_size.x);
+  glGetTextureLevelParameteriv(depth_stencil.id(), 0, GL_TEXTURE_HEIGHT,
+                               &screen_size.y);
+
+  Shader tile_shader = programs.load({"../assets/intensity_tiles.comp"});
+  tile_shader.set(STENCIL_MAP, 0);
+  tile_shader.set(DEPTH_MAP, 1);
+  tile_shader.set(MAX_DISTANCE, max_distance);
+
+  Shader shader =
+      mode == IntensityMode::StencilMask
+          ? programs.load({"../assets/stencil_mask.comp"})
+          : programs.load(
+                {"../assets/intensity.vert", "../assets/intensity.frag"});
+  shader.set(STENCIL_MAP, 0);
+  shader.set(DEPTH_MAP, 1);
+  shader.set(FALLOFF, int(falloff));
+  shader.set(MAX_DISTANCE, max_distance);
+  if (mode == IntensityMode::StencilMask) {
+    shader.set(TILE_MAP, 2);
+  } else {
+    shader.set(TILE_UV_SIZE, glm::vec2(float(SCREEN_TILE_SIZE)) /
+                                 glm::vec2(screen_size));
+    // Depth and stencil are sampled, not attached, so the pass does not
+    // form a feedback loop with the scene's depth buffer.
+    framebuffer.attach_texture(GL_COLOR_ATTACHMENT0, color, 0);
+    framebuffer.set_draw_buffer(GL_COLOR_ATTACHMENT0);
+  }
+
+  const glm::ivec2 tiles = getTileCount(screen_size);
+  world.ctx().emplace<Intensity>(
+      mode, std::move(framebuffer), color, std::move(shader),
+      DepthStencilView(depth_stencil, GL_DEPTH_COMPONENT),
+      DepthStencilView(depth_stencil, GL_STENCIL_INDEX), createTileMap(tiles),
+      createTileBuffer(tiles), std::move(tile_shader), gl::vertex_array{},
+      falloff, max_distance, screen_size, size, size);
+}
+
+void setIntensityScale(Intensity &intensity, float scale) {
+  const glm::ivec2 size =
+      glm::round(glm::vec2(intensity.allocated_size) * scale);
+  intensity.size =
+      glm::clamp(size, glm::ivec2(MIN_MASK_SIZE), intensity.allocated_size);
+}
+
+glm::vec2 getIntensityScale(const Intensity &intensity) {
+  return glm::vec2(intensity.size) / glm::vec2(intensity.allocated_size);
+}
+
+void updateIntensity(Intensity &intensity) {
+  classifyTiles(intensity);
+  if (intensity.mode == IntensityMode::StencilMask) {
+    buildStencilMask(intensity);
+  } else {
+    drawStencilClasses(intensity);
+  }
+}
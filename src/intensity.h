@@ -0,0 +1,98 @@
+#pragma once
+
+#include "components.h"
+#include "program_registry.h"
+#include "render_graph.h"
+#include "shader.h"
+
+#include <gl/all.hpp>
+#include <glm/glm.hpp>
+
+#include <optional>
+#include <string>
+
+enum class IntensityMode {
+  // One draw of the active screen tiles into a screen sized target
+  Stencil,
+  // One compute pass reading the stencil buffer and writing both classes
+  // at outline resolution
+  StencilMask,
+};
+
+// How the intensity of a tagged pixel fades with its distance to the
+// camera, reaching 0 at the maximum distance at the latest.
+enum class IntensityFalloff {
+  // Full intensity up to the maximum distance
+  Constant,
+  Linear,
+  Smooth,
+  // Inverse square of the distance in quarters of the maximum distance,
+  // windowed to reach 0 at the maximum distance
+  InverseSquare,
+};
+
+std::optional<IntensityFalloff> parseIntensityFalloff(const std::string &name);
+const char *getIntensityFalloffName(IntensityFalloff falloff);
+
+// Texture view exposing the depth or the stencil aspect of a depth-stencil
+// texture to shaders. `mode` is GL_DEPTH_COMPONENT or GL_STENCIL_INDEX, the
+// latter is read as an unsigned integer texture.
+class DepthStencilView {
+public:
+  DepthStencilView(const gl::texture_2d &depth_stencil, GLenum mode);
+  ~DepthStencilView();
+
+  DepthStencilView(const DepthStencilView &) = delete;
+  DepthStencilView &operator=(const DepthStencilView &) = delete;
+  DepthStencilView(DepthStencilView &&other) noexcept;
+  DepthStencilView &operator=(DepthStencilView &&other) noexcept;
+
+  void bind_unit(GLuint unit) const;
+
+private:
+  GLuint id_{0};
+};
+
+struct Intensity {
+  IntensityMode mode;
+  gl::framebuffer framebuffer;
+  // Interesting clues in r, traces in g. Owned by the render graph.
+  const gl::texture_2d &color;
+  Shader shader;
+  DepthStencilView depth_view;
+  DepthStencilView stencil_view;
+  // Nearest tagged distance within range per screen tile, see
+  // classifyTiles() in intensity.cpp
+  gl::texture_2d tile_map;
+  // Indirect draw of the active tiles followed by their indices
+  gl::buffer tile_buffer;
+  Shader tile_shader;
+  gl::vertex_array vao{};
+  IntensityFalloff falloff{IntensityFalloff::Smooth};
+  float max_distance{30.0f};
+  glm::ivec2 screen_size{0};
+  // Texels of `color` written by the last update, from the bottom left
+  glm::ivec2 size{0};
+  glm::ivec2 allocated_size{0};
+};
+
+// Size and format of the intensity texture for a screen of width x height.
+TextureDesc getIntensityTextureDesc(IntensityMode mode, int width, int height);
+
+void createIntensity(World &world, IntensityMode mode,
+                     const gl::texture_2d &depth_stencil,
+                     const gl::texture_2d &color, IntensityFalloff falloff,
+                     float max_distance, ProgramRegistry &programs);
+// Scales the part of `color` the next update writes, in both modes.
+// Stencil mode point samples depth and stencil at the screen pixel under
+// each texel, StencilMask covers the whole footprint.
+void setIntensityScale(Intensity &intensity, float scale);
+// Part of `color` holding the current mask, in uv.
+glm::vec2 getIntensityScale(const Intensity &intensity);
+
+// Weights every tagged pixel with the falloff of its distance to the
+// camera, reconstructed from depth with the inverse projection of the
+// per-frame uniform block. Screen tiles without a tagged pixel in range are
+// skipped. Writes the mask as an image in StencilMask mode, readers need a
+// barrier.
+void updateIntensity(Intensity &intensity);
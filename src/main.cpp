@@ -1,6 +1,25 @@
+#include "asset_manager.h"
 #include "camera.h"
+#include "clock.h"
+#include "clue_system.h"
+#include "components.h"
+#include "culling.h"
+#include "frame_packet.h"
+#include "intensity.h"
 #include "mesh.h"
+#include "options.h"
+#include "outline.h"
+#include "post_process_cpu.h"
+#include "profiler.h"
+#include "program_registry.h"
+#include "render_graph.h"
+#include "render_targets.h"
+#include "resolution_controller.h"
+#include "scene_renderer.h"
+#include "scheduler.h"
 #include "shader.h"
+#include "state_cache.h"
+#include "transform_system.h"
 
 #include <GLFW/glfw3.h>
 #include <entt/entt.hpp>
@@ -9,225 +28,129 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <thread>
 #include <vector>
 
 constexpr int WINDOW_WIDTH = 1280;
 constexpr int WINDOW_HEIGHT = 720;
+// Both outline paths store RG16F, allow a few half float ulps of drift.
+constexpr float OUTLINE_VALIDATION_TOLERANCE = 1.0e-2f;
+// CPU kernels against the GPU passes, see --validate-cpu. The GPU quantizes
+// bilinear weights, which shows most where compose samples sharp edges.
+constexpr float CPU_OUTLINE_TOLERANCE = 1.0e-2f;
+constexpr float CPU_COMPOSE_TOLERANCE = 2.0e-2f;
+constexpr float CPU_TONEMAP_TOLERANCE = 1.0e-3f;
+// Lowest scale the resolution controller may pick for outline and intensity
+constexpr float MIN_RESOLUTION_SCALE = 0.25f;
+// Draws of each compose variant timed by --compare-compose
+constexpr int COMPOSE_COMPARISON_RUNS = 200;
+// Frame stats histogram of the LODs instances are drawn with
+constexpr std::array<const char *, MAX_MESH_LODS> LOD_COUNTERS{
+    "lod0_instances", "lod1_instances", "lod2_instances", "lod3_instances"};
 
 void debugMessageCallback(const gl::debug_log& log) {
   std::cerr << log.message << std::endl;
 }
 
-struct Transform {
-  glm::vec3 translation{};
-  glm::vec3 rotation{};
-  glm::vec3 scale{1.0f};
-
-  Transform() = default;
-  Transform(const Transform &) = default;
-
-  explicit Transform(const glm::vec3 &translation) : translation{translation} {}
-
-  glm::mat4 transform() const {
-    glm::mat4 rotation_matrix = glm::toMat4(glm::quat(rotation));
-
-    return glm::translate(glm::mat4(1.0f), translation) * rotation_matrix *
-           glm::scale(glm::mat4(1.0f), scale);
-  }
-};
-
-struct Color {
-  glm::vec3 color;
-};
-
 struct DirectionalLight {
   glm::vec3 direction;
   float intensity;
   glm::vec3 color;
 };
 
-using MeshHandle = std::shared_ptr<Mesh>;
-using World = entt::registry;
-
-struct Move {};
-struct Trace {};
-struct Interesting {};
-
-struct Senses {
-  float amount{0.0f};
+// Per-frame uniform block shared by every shader, std140 at binding 1.
+struct FrameUniforms {
+  glm::mat4 view;
+  glm::mat4 proj;
+  glm::mat4 inv_proj;
+  float time;
+  float padding[3];
 };
 
-void spawnScene(World &world);
-void moveSphereSystem(World &world) {
-  world.view<Transform, Move>().each([&](Transform &transform) {
-    transform.translation.x = 5.0f * float(sin(glfwGetTime() / 1.14));
+constexpr Uniform<int, "color_map"> COLOR_MAP;
+constexpr Uniform<int, "outline_map"> OUTLINE_MAP;
+constexpr Uniform<int, "intensity_map"> INTENSITY_MAP;
+constexpr Uniform<glm::vec2, "texture_size"> TEXTURE_SIZE;
+constexpr Uniform<float, "zoom_amount"> ZOOM_AMOUNT;
+constexpr Uniform<glm::vec2, "outline_scale"> OUTLINE_SCALE;
+constexpr Uniform<glm::vec2, "intensity_scale"> INTENSITY_SCALE;
+constexpr Uniform<std::span<const glm::vec2>, "circle_directions">
+    CIRCLE_DIRECTIONS;
+
+void spawnScene(World &world, AssetManager &assets);
+void moveSphereSystem(World &world, ThreadPool &pool) {
+  const auto &time = world.ctx().at<const Time>();
+  const float x = 5.0f * float(sin(time.elapsed / 1.14));
+  auto view = world.view<Transform, const Move>();
+  parallelEach(pool, view, [&](entt::entity entity) {
+    view.get<Transform>(entity).translation.x = x;
   });
+  markUpdated<Transform, const Move>(world);
 }
 
-struct Offscreen {
-  gl::framebuffer framebuffer;
-  gl::texture_2d color;
-  gl::texture_2d depth_stencil;
-};
-
-Offscreen createOffscreenFramebuffer(World &world, int width, int height, std::size_t color_format) {
-  gl::texture_2d color;
-  color.set_min_filter(GL_LINEAR);
-  color.set_mag_filter(GL_LINEAR);
-  color.set_wrap_s(GL_REPEAT);
-  color.set_wrap_t(GL_REPEAT);
-  color.set_storage(1, color_format, width, height);
-
-  gl::texture_2d depth_stencil;
-  depth_stencil.set_min_filter(GL_LINEAR);
-  depth_stencil.set_mag_filter(GL_LINEAR);
-  depth_stencil.set_wrap_s(GL_REPEAT);
-  depth_stencil.set_wrap_t(GL_REPEAT);
-  depth_stencil.set_storage(1, GL_DEPTH24_STENCIL8, width, height);
-
-  gl::framebuffer framebuffer;
+void attachRenderTargets(gl::framebuffer &framebuffer,
+                         const gl::texture_2d &color,
+                         const gl::texture_2d *depth_stencil) {
   framebuffer.attach_texture(GL_COLOR_ATTACHMENT0, color, 0);
-  framebuffer.attach_texture(GL_DEPTH_STENCIL_ATTACHMENT, depth_stencil, 0);
+  if (depth_stencil) {
+    framebuffer.attach_texture(GL_DEPTH_STENCIL_ATTACHMENT, *depth_stencil, 0);
+  }
   framebuffer.set_draw_buffer(GL_COLOR_ATTACHMENT0);
-
-  return Offscreen{
-      std::move(framebuffer),
-      std::move(color),
-      std::move(depth_stencil),
-  };
 }
 
-struct Intensity {
-  gl::framebuffer framebuffer;
-  gl::texture_2d color;
-  Shader shader;
-};
-
-void createIntensityFramebuffer(World &world, int width, int height) {
-  gl::texture_2d color;
-  color.set_min_filter(GL_LINEAR);
-  color.set_mag_filter(GL_LINEAR);
-  color.set_wrap_s(GL_REPEAT);
-  color.set_wrap_t(GL_REPEAT);
-  color.set_storage(1, GL_R11F_G11F_B10F, width, height);
-
-  gl::framebuffer framebuffer;
-  framebuffer.attach_texture(GL_COLOR_ATTACHMENT0, color, 0);
-  framebuffer.set_draw_buffer(GL_COLOR_ATTACHMENT0);
-
-  gl::shader vertex(GL_VERTEX_SHADER);
-  vertex.load_source("../assets/intensity.vert");
-  if (!vertex.compile()) {
-    std::cerr << "Shader compilation error: " << vertex.info_log() << '\n';
-  }
-  gl::shader fragment(GL_FRAGMENT_SHADER);
-  fragment.load_source("../assets/intensity.frag");
-  if (!fragment.compile()) {
-    std::cerr << "Shader compilation error: " << fragment.info_log() << '\n';
-  }
-
-  gl::program program;
-  program.attach_shader(vertex);
-  program.attach_shader(fragment);
-  if (!program.link()) {
-    std::cerr << "Not linked: " << program.info_log() << '\n';
+RenderTargetFormats resolveRenderTargetFormats(const Options &options) {
+  const auto preset = parseTargetPreset(options.target_preset);
+  if (!preset) {
+    std::cerr << "Unknown render target preset: " << options.target_preset
+              << '\n';
     exit(EXIT_FAILURE);
   }
+  auto formats = getRenderTargetFormats(*preset);
 
-  world.ctx().emplace<Intensity>(std::move(framebuffer), std::move(color),
-                                 Shader(std::move(program)));
+  const auto override_format = [](const std::string &name, GLenum &format) {
+    if (name.empty()) {
+      return;
+    }
+    if (const auto parsed = parseTextureFormat(name)) {
+      format = *parsed;
+    } else {
+      std::cerr << "Unknown texture format: " << name << '\n';
+      exit(EXIT_FAILURE);
+    }
+  };
+  override_format(options.color_format, formats.color);
+  override_format(options.hdr_format, formats.hdr);
+  return formats;
 }
 
-class PingPong {
-public:
-  PingPong(std::array<gl::texture_2d, 2> &&textures)
-      : textures_{std::move(textures)} {}
-
-  void swap() { current_index_ = 1 - current_index_; }
-
-  const gl::texture_2d &current() const { return textures_[current_index_]; }
-
-  const gl::texture_2d &next() const { return textures_[1 - current_index_]; }
-
-private:
-  std::array<gl::texture_2d, 2> textures_;
-  uint32_t current_index_ = 0;
-};
-
-struct Outline {
-  gl::framebuffer framebuffer;
-  PingPong textures;
-  Shader shader;
-};
-
-void createOutline(World &world) {
-  gl::texture_2d color_1;
-  color_1.set_min_filter(GL_LINEAR);
-  color_1.set_mag_filter(GL_LINEAR);
-  color_1.set_wrap_s(GL_REPEAT);
-  color_1.set_wrap_t(GL_REPEAT);
-  color_1.set_storage(1, GL_RG16F, 512, 512);
-
-  gl::texture_2d color_2;
-  color_2.set_min_filter(GL_LINEAR);
-  color_2.set_mag_filter(GL_LINEAR);
-  color_2.set_wrap_s(GL_REPEAT);
-  color_2.set_wrap_t(GL_REPEAT);
-  color_2.set_storage(1, GL_RG16F, 512, 512);
-
-  gl::framebuffer framebuffer;
-  framebuffer.attach_texture(GL_COLOR_ATTACHMENT0, color_1, 0);
-  framebuffer.set_draw_buffer(GL_COLOR_ATTACHMENT0);
-
-  gl::shader vertex(GL_VERTEX_SHADER);
-  vertex.load_source("../assets/outline.vert");
-  if (!vertex.compile()) {
-    std::cerr << "Shader compilation error: " << vertex.info_log() << '\n';
-  }
-  gl::shader fragment(GL_FRAGMENT_SHADER);
-  fragment.load_source("../assets/outline.frag");
-  if (!fragment.compile()) {
-    std::cerr << "Shader compilation error: " << fragment.info_log() << '\n';
+// Directions of the eight samples compose.frag takes around every pixel.
+std::array<glm::vec2, 8> computeCircleDirections(float time) {
+  constexpr float PI_4 = 3.1415f / 4.0f;
+  const float time_param = time * 0.1f;
+  std::array<glm::vec2, 8> directions{};
+  for (int i = 0; i < 8; ++i) {
+    const float angle = float(i) * PI_4 - time_param;
+    directions[i] = {std::cos(angle), std::sin(angle)};
   }
-
-  gl::program program;
-  program.attach_shader(vertex);
-  program.attach_shader(fragment);
-  if (!program.link()) {
-    std::cerr << "Not linked: " << program.info_log() << '\n';
-    exit(EXIT_FAILURE);
-  }
-
-  Shader shader(std::move(program));
-  shader.setUniform("intensity_map", 0);
-  shader.setUniform("outline_map", 1);
-
-  world.ctx().emplace<Outline>(
-      std::move(framebuffer),
-      PingPong({std::move(color_1), std::move(color_2)}), std::move(shader));
+  return directions;
 }
 
-struct Input {
-  bool initialized{false};
-  float horizontal{};
-  float vertical{};
-  bool senses{false};
-  glm::vec2 mouse_pos{};
-  glm::vec2 mouse_delta{};
-  bool left_mouse{};
-  bool right_mouse{};
-};
-
 void cursorPosCallback(GLFWwindow *window, double xpos, double ypos) {
   auto *world = static_cast<World *>(glfwGetWindowUserPointer(window));
   auto &input = world->ctx().at<Input>();
   auto &last_pos = input.mouse_pos;
   glm::vec2 new_pos((float)xpos, (float)ypos);
   if (input.initialized) {
-    input.mouse_delta = new_pos - last_pos;
+    // Several events can arrive per frame, the delta is consumed once.
+    input.mouse_delta += new_pos - last_pos;
   } else {
     input.initialized = true;
   }
@@ -272,6 +195,10 @@ void keyboardCallback(GLFWwindow *window, int key, int scancode, int action,
       break;
     case GLFW_KEY_E:
       input.senses = true;
+      break;
+    case GLFW_KEY_O:
+      input.outline_compute = !input.outline_compute;
+      break;
     default:
       break;
     }
@@ -303,34 +230,53 @@ void resetMouseDelta(World &world) {
 }
 
 void updateCameraView(World &world) {
-  world.view<const Transform, Camera>().each(
-      [](const auto &transform, auto &camera) {
-        camera.updateView(transform.transform());
+  world.view<const WorldMatrix, Camera>().each(
+      [](const auto &world_matrix, auto &camera) {
+        camera.updateView(world_matrix.matrix);
       });
 }
 
-void controlCamera(World &world) {
+// The mouse delta is a distance rather than a rate, so it is applied once
+// per frame and not scaled by time.
+void lookCamera(World &world) {
+  const auto &input = world.ctx().at<const Input>();
+  // Radians per pixel
+  const float sensitivity = 0.1f / 60.0f;
+  if (input.mouse_delta == glm::vec2(0.0f)) {
+    return;
+  }
+  for (auto entity : world.view<Transform, const Camera>()) {
+    world.patch<Transform>(entity, [&](Transform &transform) {
+      transform.rotation.y -= input.mouse_delta.x * sensitivity;
+      transform.rotation.x += input.mouse_delta.y * sensitivity;
+    });
+  }
+}
+
+void moveCamera(World &world) {
   const auto &input = world.ctx().at<const Input>();
-  const float dt = 1.0f / 60.0f; // TODO
+  const float dt = world.ctx().at<const Time>().dt;
   const float speed = 10.0f;
-  const float angular_speed = 0.1f;
-  world.view<Transform, const Camera>().each([&](auto &transform,
-                                                 const auto &camera) {
-    transform.rotation.y -= input.mouse_delta.x * angular_speed * dt;
-    transform.rotation.x += input.mouse_delta.y * angular_speed * dt;
-
-    const auto &m = transform.transform();
-    transform.translation -= glm::vec3((m * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f) *
-                                        input.horizontal * speed * dt));
-    transform.translation += glm::vec3(
-        (m * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f) * input.vertical * speed * dt));
-  });
+  if (input.horizontal == 0.0f && input.vertical == 0.0f) {
+    return;
+  }
+  for (auto entity : world.view<Transform, const Camera>()) {
+    world.patch<Transform>(entity, [&](Transform &transform) {
+      const glm::quat rotation(transform.rotation);
+      const glm::vec3 right =
+          rotation * (transform.scale * glm::vec3(1.0f, 0.0f, 0.0f));
+      const glm::vec3 forward =
+          rotation * (transform.scale * glm::vec3(0.0f, 0.0f, 1.0f));
+      transform.translation -= right * input.horizontal * speed * dt;
+      transform.translation += forward * input.vertical * speed * dt;
+    });
+  }
 }
 
 void controlSenses(World &world) {
   const auto &input = world.ctx().at<const Input>();
   auto &senses = world.ctx().at<Senses>();
-  const float dt = 1.0f / 60.0f;
+  const float dt = world.ctx().at<const Time>().dt;
   if (input.senses) {
     senses.amount += dt;
   } else {
@@ -339,11 +285,24 @@ void controlSenses(World &world) {
   senses.amount = std::max(0.0f, std::min(1.0f, senses.amount));
 }
 
-int main() {
+int main(int argc, char **argv) {
+  const auto startup_start = std::chrono::steady_clock::now();
+  const Options options = parseOptions(argc, argv);
+
   glfwSetErrorCallback([](int error, const char *description) {
     std::cerr << "Error: " << description << '\n';
   });
 
+#ifdef GLFW_PLATFORM_NULL
+  if (options.null_platform) {
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+  }
+#else
+  if (options.null_platform) {
+    std::cerr << "GLFW null platform is not available, using a hidden window\n";
+  }
+#endif
+
   if (!glfwInit()) {
     exit(EXIT_FAILURE);
   }
@@ -352,6 +311,12 @@ int main() {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  if (options.hidden_window) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
+  if (options.null_platform) {
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+  }
 
   GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT,
                                         "Witcher Senses", nullptr, nullptr);
@@ -360,7 +325,12 @@ int main() {
     return EXIT_FAILURE;
   }
   glfwMakeContextCurrent(window);
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  if (!options.hidden_window) {
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  }
+  if (options.frames != 0) {
+    glfwSwapInterval(0);
+  }
   gl::initialize();
 
 #ifndef NDEBUG
@@ -373,45 +343,52 @@ int main() {
 
   entt::registry world;
   world.ctx().emplace<Input>();
-  world.ctx().emplace<Senses>();
+  world.ctx().emplace<Senses>().radius = options.sense_radius;
+  world.ctx().at<Input>().senses = options.senses;
+  world.ctx().at<Input>().outline_compute = options.outline_compute;
+  world.ctx().emplace<Time>();
+  registerTransformTracking(world);
+  // Cells as large as the sense radius, a query visits 3x3x3 of them.
+  registerClueTracking(world, options.sense_radius);
 
   glfwSetWindowUserPointer(window, &world);
   glfwSetCursorPosCallback(window, cursorPosCallback);
   glfwSetMouseButtonCallback(window, mouseButtonCallback);
   glfwSetKeyCallback(window, keyboardCallback);
 
-  auto create_shader = [&](const char *vert_path, const char *frag_path) {
-    gl::shader vert_shader(GL_VERTEX_SHADER);
-    vert_shader.load_source(vert_path);
-    if (!vert_shader.compile()) {
-      std::cerr << "Shader compilation error: " << vert_shader.info_log()
-                << '\n';
-    }
-
-    gl::shader frag_shader(GL_FRAGMENT_SHADER);
-    frag_shader.load_source(frag_path);
-    if (!frag_shader.compile()) {
-      std::cerr << "Shader compilation error: " << frag_shader.info_log()
-                << '\n';
-    }
+  const auto mesh_layout = parseVertexLayout(options.mesh_layout);
+  if (!mesh_layout) {
+    std::cerr << "Unknown mesh layout: " << options.mesh_layout << '\n';
+    exit(EXIT_FAILURE);
+  }
+  std::vector<std::string> object_defines;
+  if (*mesh_layout == VertexLayout::Compact) {
+    object_defines.emplace_back("OCTAHEDRAL_NORMALS");
+  }
 
-    gl::program program;
-    program.attach_shader(vert_shader);
-    program.attach_shader(frag_shader);
-    if (!program.link()) {
-      std::cout << program.info_log() << '\n';
+  ProgramRegistry programs(options.shader_cache, options.watch_shaders);
+  Shader object_shader = programs.load(
+      {"../assets/object.vert", "../assets/object.frag"}, object_defines);
+  Shader depth_shader = programs.load(
+      {"../assets/object.vert", "../assets/depth.frag"}, object_defines);
+
+  ThreadPool thread_pool;
+  AssetManager assets(thread_pool, *mesh_layout);
+  spawnScene(world, assets);
+  if (options.deterministic_clock) {
+    // Reproducible runs start with every asset resident.
+    while (assets.getPendingCount() != 0) {
+      assets.update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-    return Shader(std::move(program));
-  };
-  Shader object_shader =
-      create_shader("../assets/object.vert", "../assets/object.frag");
-  object_shader.use();
-
-  spawnScene(world);
+  }
   {
     auto camera_entity = world.create();
     Camera camera((float)WINDOW_WIDTH / WINDOW_HEIGHT, 45.0f, 0.01f, 1000.0f);
-    world.emplace<Transform>(camera_entity, Transform{{3.0f, 3.0f, -10.0f}});
+    const Transform transform{{3.0f, 3.0f, -10.0f}};
+    world.emplace<Transform>(camera_entity, transform);
+    world.emplace<Interpolated>(camera_entity,
+                                Interpolated{transform.translation});
     world.emplace<Camera>(camera_entity, camera);
   }
 
@@ -425,34 +402,82 @@ int main() {
   light_ubo.set_data(sizeof(DirectionalLight), &directional_light);
   light_ubo.bind_base(GL_UNIFORM_BUFFER, 0);
 
-  const auto color = createOffscreenFramebuffer(world, WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGB32F);
-  const auto hdr = createOffscreenFramebuffer(world, WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGB32F);
-  const auto ldr = createOffscreenFramebuffer(world, WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA8);
-  createIntensityFramebuffer(world, WINDOW_WIDTH, WINDOW_HEIGHT);
-  createOutline(world);
+  FrameUniforms frame_uniforms{};
+  gl::buffer frame_ubo;
+  frame_ubo.set_data(sizeof(FrameUniforms), &frame_uniforms);
+  frame_ubo.bind_base(GL_UNIFORM_BUFFER, 1);
+
+  const auto formats = resolveRenderTargetFormats(options);
+  const auto intensity_mode = options.stencil_mask ? IntensityMode::StencilMask
+                                                   : IntensityMode::Stencil;
+  const auto intensity_falloff =
+      parseIntensityFalloff(options.intensity_falloff);
+  if (!intensity_falloff) {
+    std::cerr << "Unknown intensity falloff: " << options.intensity_falloff
+              << '\n';
+    exit(EXIT_FAILURE);
+  }
+
+  if (!RenderGraph::selfCheck(std::cerr)) {
+    exit(EXIT_FAILURE);
+  }
+  RenderGraph graph;
+  // No two of these share a texture: color and hdr are both live in the
+  // compose pass and the others differ in format or size.
+  const auto scene_color = graph.createTexture(
+      "color", {WINDOW_WIDTH, WINDOW_HEIGHT, formats.color});
+  const auto depth_stencil = graph.createTexture(
+      "depth_stencil", {WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH24_STENCIL8});
+  const auto intensity_target = graph.createTexture(
+      "intensity",
+      getIntensityTextureDesc(intensity_mode, WINDOW_WIDTH, WINDOW_HEIGHT));
+  // Only written when tonemapping runs as its own pass, culled otherwise.
+  const auto hdr = graph.createTexture(
+      "hdr", {WINDOW_WIDTH, WINDOW_HEIGHT, formats.hdr});
+  // Only the two outline quadrants compose reads, see packOutlineClasses().
+  const auto outline_classes = graph.createTexture(
+      "outline_classes",
+      {OUTLINE_CLASSES_SIZE, OUTLINE_CLASSES_SIZE, GL_RG16F});
+  // Outline history is ping-ponged across frames by Outline itself.
+  const auto outline_history = graph.importTexture("outline", true);
+  const auto backbuffer = graph.importTexture("backbuffer", true);
 
   glm::vec2 texture_size((float) WINDOW_WIDTH, (float) WINDOW_HEIGHT);
-  Shader compose_shader =
-      create_shader("../assets/compose.vert", "../assets/compose.frag");
-  compose_shader.use();
-  compose_shader.setUniform("color_map", 0);
-  compose_shader.setUniform("outline_map", 1);
-  compose_shader.setUniform("intensity_map", 2);
-  compose_shader.setUniform("texture_size", texture_size);
+  std::vector<std::string> compose_defines;
+  if (!options.separate_tonemap) {
+    compose_defines.emplace_back("FUSED_TONEMAP");
+  }
+  Shader compose_shader = programs.load(
+      {"../assets/compose.vert", "../assets/compose.frag"}, compose_defines);
+  compose_shader.set(COLOR_MAP, 0);
+  compose_shader.set(OUTLINE_MAP, 1);
+  compose_shader.set(INTENSITY_MAP, 2);
+  compose_shader.set(TEXTURE_SIZE, texture_size);
 
-  Shader colormap_shader =
-      create_shader("../assets/compose.vert", "../assets/colormapping.frag");
+  compose_defines.emplace_back("SENSES_OFF");
+  Shader compose_copy_shader = programs.load(
+      {"../assets/compose.vert", "../assets/compose.frag"}, compose_defines);
+  compose_copy_shader.set(COLOR_MAP, 0);
+
+  Shader colormap_shader = programs.load(
+      {"../assets/compose.vert", "../assets/colormapping.frag"});
 
   gl::vertex_array quad_vao;
+  const auto culling = parseCullingMode(options.culling);
+  if (!culling) {
+    std::cerr << "Unknown culling mode: " << options.culling << '\n';
+    exit(EXIT_FAILURE);
+  }
+  SceneRenderer scene_renderer(programs, *culling, options.lod_screen_size);
 
-  while (!glfwWindowShouldClose(window)) {
-    moveSphereSystem(world);
-    controlCamera(world);
-    controlSenses(world);
-    updateCameraView(world);
+  const auto camera_entity = world.view<const Camera>()[0];
+  // Packet of the frame the render thread is submitting
+  const FramePacket *packet = nullptr;
+  gl::framebuffer scene_framebuffer;
+  gl::framebuffer hdr_framebuffer;
 
-//    const auto &hdr = world.ctx().at<const Offscreen>();
-    color.framebuffer.bind();
+  const auto setup_scene_pass = [&] {
+    scene_framebuffer.bind();
     gl::set_viewport({0, 0}, {WINDOW_WIDTH, WINDOW_HEIGHT});
     gl::set_clear_color({0.3, 0.3, 0.3, 1.0});
     gl::clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
@@ -463,98 +488,543 @@ int main() {
 
     gl::set_stencil_mask(0xff);
     gl::set_stencil_operation(GL_KEEP, GL_KEEP, GL_REPLACE);
-    object_shader.use();
-    const auto camera_entity = world.view<const Camera>()[0];
-    const auto &camera = world.get<const Camera>(camera_entity);
-    object_shader.setUniform("view", camera.getView());
-    object_shader.setUniform("proj", camera.getProjection());
-
-    gl::set_stencil_function(GL_ALWAYS, 0x00, 0xff);
-    auto traces = world.view<Trace>();
-    auto interesting = world.view<Interesting>();
-    world.view<Transform, MeshHandle, Color>().each(
-        [&](auto entity, const auto &transform, const auto &mesh,
-            const auto &color) {
-          object_shader.setUniform("color", color.color);
-          object_shader.setUniform("model", transform.transform());
-          mesh->bind();
-          if (traces.contains(entity)) {
-            gl::set_stencil_function(GL_ALWAYS, 0x8, 0xff);
-          } else if (interesting.contains(entity)) {
-            gl::set_stencil_function(GL_ALWAYS, 0x4, 0xff);
-          } else {
-            gl::set_stencil_function(GL_ALWAYS, 0x0, 0xff);
-          }
-          gl::draw_elements(GL_TRIANGLES, mesh->getIndexCount(),
-                            GL_UNSIGNED_INT, nullptr);
-        });
-
-    gl::set_depth_test_enabled(false);
-    gl::set_stencil_operation(GL_KEEP, GL_KEEP, GL_KEEP);
-    auto &intensity = world.ctx().at<Intensity>();
-    intensity.framebuffer.bind();
-    intensity.framebuffer.attach_texture(GL_DEPTH_STENCIL_ATTACHMENT,
-                                         color.depth_stencil, 0);
-
-    gl::set_clear_color({0.0, 0.0, 0.0, 1.0});
-    gl::clear(GL_COLOR_BUFFER_BIT);
-    intensity.shader.use();
-    intensity.shader.setUniform("color", glm::vec3(1.0, 0.0, 0.0));
-    gl::set_stencil_mask(0xFF);
-    gl::set_stencil_function(GL_LESS, 0x00, 0x04);
-    quad_vao.bind();
-    gl::draw_arrays(GL_TRIANGLES, 0, 6);
-    intensity.shader.setUniform("color", glm::vec3(0.0, 1.0, 0.0));
-    gl::set_stencil_function(GL_LESS, 0x00, 0x08);
-    gl::draw_arrays(GL_TRIANGLES, 0, 6);
+    scene_renderer.prepare(*packet);
+  };
 
-    gl::set_stencil_test_enabled(false);
-    auto &outline = world.ctx().at<Outline>();
-    outline.framebuffer.bind();
-    outline.framebuffer.attach_texture(GL_COLOR_ATTACHMENT0,
-                                       outline.textures.current());
-    outline.shader.use();
-    outline.shader.setUniform("time", (float)glfwGetTime());
-    gl::set_viewport({0, 0}, {512, 512});
-    intensity.color.bind_unit(0);
-    outline.textures.next().bind_unit(1);
-    gl::clear(GL_COLOR_BUFFER_BIT);
-    gl::draw_arrays(GL_TRIANGLES, 0, 6);
+  if (options.depth_prepass) {
+    // Depth and stencil tags first, so the lit pass below shades every
+    // pixel once.
+    graph.addPass("depth_prepass", {},
+                  {{scene_color, Access::Attachment},
+                   {depth_stencil, Access::Attachment}},
+                  [&] {
+                    setup_scene_pass();
+                    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                    depth_shader.use();
+                    scene_renderer.draw();
+                    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                  });
+    graph.addPass("scene", {{depth_stencil, Access::Attachment}},
+                  {{scene_color, Access::Attachment}}, [&] {
+                    glDepthMask(GL_FALSE);
+                    glDepthFunc(GL_EQUAL);
+                    gl::set_stencil_operation(GL_KEEP, GL_KEEP, GL_KEEP);
+                    object_shader.use();
+                    scene_renderer.draw();
+                    glDepthFunc(GL_LESS);
+                    glDepthMask(GL_TRUE);
+                  });
+  } else {
+    graph.addPass("scene", {},
+                  {{scene_color, Access::Attachment},
+                   {depth_stencil, Access::Attachment}},
+                  [&] {
+                    setup_scene_pass();
+                    object_shader.use();
+                    scene_renderer.draw();
+                  });
+  }
+
+  graph.addPass(
+      "intensity",
+      {{depth_stencil, Access::Sampled}},
+      {{intensity_target, intensity_mode == IntensityMode::StencilMask
+                              ? Access::Image
+                              : Access::Attachment}},
+      [&] {
+        gl::set_depth_test_enabled(false);
+        updateIntensity(world.ctx().at<Intensity>());
+      });
 
-    const auto &senses = world.ctx().at<Senses>();
-    hdr.framebuffer.bind();
+  // The outline mode can be toggled at runtime, so its write is declared as
+  // an image store either way.
+  graph.addPass("outline",
+                {{intensity_target, Access::Sampled},
+                 {depth_stencil, Access::Sampled},
+                 {outline_history, Access::Sampled}},
+                {{outline_history, Access::Image},
+                 {outline_classes, Access::Image}},
+                [&] {
+                  gl::set_stencil_test_enabled(false);
+                  auto &outline = world.ctx().at<Outline>();
+                  updateOutline(
+                      outline, graph.getTexture(intensity_target),
+                      getIntensityScale(world.ctx().at<Intensity>()));
+                  packOutlineClasses(outline,
+                                     graph.getTexture(outline_classes));
+                });
+
+  // Both draw into the bound framebuffer, they are also run by
+  // --validate-cpu after the last frame.
+  const auto draw_compose = [&](float senses, float time, bool fast_path) {
     gl::set_viewport({0, 0}, {WINDOW_WIDTH, WINDOW_HEIGHT});
-    compose_shader.use();
-    compose_shader.setUniform("time", (float) glfwGetTime());
-    compose_shader.setUniform("zoom_amount", senses.amount);
-    color.color.bind_unit(0);
-    outline.textures.current().bind_unit(1);
-    intensity.color.bind_unit(2);
+    auto &state = StateCache::get();
+    state.bindVertexArray(quad_vao.id());
+    state.bindTextureUnit(0, graph.getTexture(scene_color).id());
+    if (senses == 0.0f && fast_path) {
+      compose_copy_shader.use();
+    } else {
+      const auto directions = computeCircleDirections(time);
+      const auto &outline = world.ctx().at<Outline>();
+      compose_shader.use();
+      compose_shader.set(ZOOM_AMOUNT, senses);
+      compose_shader.set(CIRCLE_DIRECTIONS, directions);
+      compose_shader.set(OUTLINE_SCALE, getOutlineScale(outline));
+      compose_shader.set(INTENSITY_SCALE,
+                         getIntensityScale(world.ctx().at<Intensity>()));
+      state.bindTextureUnit(1, graph.getTexture(outline_classes).id());
+      state.bindTextureUnit(2, graph.getTexture(intensity_target).id());
+    }
     gl::clear(GL_COLOR_BUFFER_BIT);
     gl::draw_arrays(GL_TRIANGLES, 0, 6);
+  };
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  const auto draw_colormapping = [&](const gl::texture_2d &source) {
+    gl::set_viewport({0, 0}, {WINDOW_WIDTH, WINDOW_HEIGHT});
+    auto &state = StateCache::get();
+    state.bindVertexArray(quad_vao.id());
     colormap_shader.use();
-    hdr.color.bind_unit(0);
+    state.bindTextureUnit(0, source.id());
     gl::clear(GL_COLOR_BUFFER_BIT);
     gl::draw_arrays(GL_TRIANGLES, 0, 6);
+  };
+
+  graph.addPass(
+      "compose",
+      {{scene_color, Access::Sampled},
+       {intensity_target, Access::Sampled},
+       {outline_classes, Access::Sampled}},
+      {{options.separate_tonemap ? hdr : backbuffer, Access::Attachment}},
+      [&] {
+        if (options.separate_tonemap) {
+          hdr_framebuffer.bind();
+        } else {
+          glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        draw_compose(packet->senses, (float)packet->time,
+                     options.compose_fast_path);
+      });
+
+  if (options.separate_tonemap) {
+    graph.addPass("colormapping", {{hdr, Access::Sampled}},
+                  {{backbuffer, Access::Attachment}}, [&] {
+                    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                    draw_colormapping(graph.getTexture(hdr));
+                  });
+  }
+
+  graph.compile();
+  attachRenderTargets(scene_framebuffer, graph.getTexture(scene_color),
+                      &graph.getTexture(depth_stencil));
+  if (!graph.isCulled(hdr)) {
+    attachRenderTargets(hdr_framebuffer, graph.getTexture(hdr), nullptr);
+  }
+  createIntensity(world, intensity_mode, graph.getTexture(depth_stencil),
+                  graph.getTexture(intensity_target), *intensity_falloff,
+                  options.intensity_max_distance, programs);
+  createOutline(world,
+                options.outline_compute ? OutlineMode::Compute
+                                        : OutlineMode::Fragment,
+                graph.getTexture(depth_stencil), programs);
+  world.ctx().at<Outline>().reproject = options.outline_reprojection;
+
+  MemoryReport memory_report;
+  graph.addToMemoryReport(memory_report);
+  memory_report.add("outline[0]", OUTLINE_SIZE, OUTLINE_SIZE, GL_RGBA16F);
+  memory_report.add("outline[1]", OUTLINE_SIZE, OUTLINE_SIZE, GL_RGBA16F);
+  memory_report.print(std::cout);
+  graph.printSummary(std::cout);
+
+  ResolutionController resolution(
+      options.frame_budget_ms,
+      std::min(MIN_RESOLUTION_SCALE, options.resolution_scale),
+      options.resolution_scale);
+
+  Profiler profiler;
+  profiler.setInfo("renderer",
+                   reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+  profiler.setInfo("resolution", std::to_string(WINDOW_WIDTH) + "x" +
+                                     std::to_string(WINDOW_HEIGHT));
+  profiler.setInfo("clock", options.deterministic_clock ? "fixed" : "real");
+  profiler.setInfo("tick_rate", std::to_string(options.tick_rate));
+  profiler.setInfo("senses", options.senses ? "on" : "off");
+  profiler.setInfo("compose_fast_path",
+                   options.compose_fast_path ? "on" : "off");
+  profiler.setInfo("culling", getCullingModeName(*culling));
+  profiler.setInfo("mesh_layout", getVertexLayoutName(*mesh_layout));
+  profiler.setInfo("lod_screen_size", std::to_string(options.lod_screen_size));
+  profiler.setInfo("frame_budget_ms",
+                   std::to_string(options.frame_budget_ms));
+  profiler.setInfo("depth_prepass", options.depth_prepass ? "on" : "off");
+  profiler.setInfo("outline_reprojection",
+                   options.outline_reprojection ? "on" : "off");
+  profiler.setInfo("intensity_falloff",
+                   getIntensityFalloffName(*intensity_falloff));
+  profiler.setInfo("intensity_max_distance",
+                   std::to_string(options.intensity_max_distance));
+  profiler.setInfo("color_format", getTextureFormatName(formats.color));
+  profiler.setInfo("hdr_format", graph.isCulled(hdr)
+                                     ? "fused"
+                                     : getTextureFormatName(formats.hdr));
+  profiler.setInfo("render_target_bytes",
+                   std::to_string(memory_report.getTotalBytes()));
+
+  std::unique_ptr<Clock> clock;
+  if (options.deterministic_clock) {
+    clock = std::make_unique<DeterministicClock>(toDuration(options.fixed_dt));
+  } else {
+    clock = std::make_unique<RealClock>();
+  }
+  Scheduler scheduler(thread_pool, std::move(clock),
+                      toDuration(1.0 / options.tick_rate));
+  scheduler.add(Stage::Input, "look_camera",
+                SystemAccess()
+                    .read<Input, Camera>()
+                    .write<Transform, TransformDirty>(),
+                lookCamera);
+  scheduler.add(Stage::Input, "reset_mouse_delta",
+                SystemAccess().write<Input>(), resetMouseDelta);
+  scheduler.add(Stage::Fixed, "store_previous_translations",
+                SystemAccess().read<Transform>().write<Interpolated>(),
+                storePreviousTranslations);
+  scheduler.add(Stage::Fixed, "move_sphere",
+                SystemAccess()
+                    .read<Time, Move>()
+                    .write<Transform, TransformDirty>(),
+                [&thread_pool](World &world) {
+                  moveSphereSystem(world, thread_pool);
+                });
+  scheduler.add(Stage::Fixed, "move_camera",
+                SystemAccess()
+                    .read<Input, Time, Camera>()
+                    .write<Transform, TransformDirty>(),
+                moveCamera);
+  scheduler.add(Stage::Fixed, "control_senses",
+                SystemAccess().read<Input, Time>().write<Senses>(),
+                controlSenses);
+  scheduler.add(Stage::Render, "update_clue_index",
+                SystemAccess()
+                    .read<Transform, TransformDirty, Trace, Interesting>()
+                    .write<ClueIndex>(),
+                updateClueIndex);
+  scheduler.add(Stage::Render, "update_world_matrices",
+                SystemAccess()
+                    .read<Transform, Time>()
+                    .write<WorldMatrix, TransformDirty, Interpolated>(),
+                [&thread_pool](World &world) {
+                  updateWorldMatrices(world,
+                                      world.ctx().at<const Time>().alpha,
+                                      &thread_pool);
+                });
+  scheduler.add(Stage::Render, "update_camera_view",
+                SystemAccess().read<WorldMatrix>().write<Camera>(),
+                updateCameraView);
+  scheduler.add(Stage::Render, "query_sense_range",
+                SystemAccess()
+                    .read<WorldMatrix, Camera, Senses>()
+                    .write<ClueIndex>(),
+                querySenseRange);
+  // Views create missing storage, which must not happen from two systems
+  // running at the same time.
+  world.storage<Move>();
+  world.storage<Interpolated>();
+  world.storage<TransformDirty>();
+  world.storage<Trace>();
+  world.storage<Interesting>();
+  profiler.setInfo("thread_pool_threads",
+                   std::to_string(thread_pool.getThreadCount()));
+  profiler.setInfo("max_parallel_systems",
+                   std::to_string(scheduler.getMaxWaveSize()));
+
+  profiler.setInfo("render_thread", options.render_thread ? "on" : "off");
+
+  // Run twice to compare a cold and a warm program cache.
+  const double startup_ms =
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - startup_start)
+          .count();
+  std::cout << "Startup: " << startup_ms << " ms, "
+            << programs.getProgramCount() << " programs in "
+            << programs.getLoadMs() << " ms ("
+            << programs.getCacheHitCount() << " cached, "
+            << programs.getCompileCount() << " compiled)\n";
+  profiler.setInfo("startup_ms", std::to_string(startup_ms));
+  profiler.setInfo("program_load_ms", std::to_string(programs.getLoadMs()));
+  profiler.setInfo("program_cache_hits",
+                   std::to_string(programs.getCacheHitCount()));
+  profiler.setInfo("program_compiles",
+                   std::to_string(programs.getCompileCount()));
+
+  const auto simulate_frame = [&](FramePacket &frame_packet) {
+    scheduler.update(world, profiler);
+    buildFramePacket(world, camera_entity, frame_packet);
+    profiler.setCounter("clues_in_range",
+                        world.ctx().at<const ClueIndex>().getInRangeCount());
+  };
+
+  const auto render_frame = [&](const FramePacket &frame_packet) {
+    packet = &frame_packet;
+    profiler.beginFrame();
+    assets.update();
+    programs.update();
+
+    resolution.update(profiler.getLastGpuFrameMs());
+    auto &outline = world.ctx().at<Outline>();
+    outline.mode = frame_packet.outline_mode;
+    setOutlineScale(outline, resolution.getScale());
+    setOutlineCamera(outline, frame_packet.proj * frame_packet.view);
+    setIntensityScale(world.ctx().at<Intensity>(), resolution.getScale());
+
+    frame_uniforms.view = frame_packet.view;
+    frame_uniforms.proj = frame_packet.proj;
+    frame_uniforms.inv_proj = glm::inverse(frame_packet.proj);
+    frame_uniforms.time = (float)frame_packet.time;
+    frame_ubo.set_data(sizeof(FrameUniforms), &frame_uniforms);
+
+    graph.execute(profiler);
 
     outline.textures.swap();
 
-    resetMouseDelta(world);
+    auto &state = StateCache::get();
+    profiler.setCounter("draw_calls", scene_renderer.getDrawCount());
+    profiler.setCounter("instances", scene_renderer.getInstanceCount());
+    if (*culling != CullingMode::Gpu) {
+      profiler.setCounter("visible_instances",
+                          scene_renderer.getVisibleCount());
+    }
+    for (uint32_t lod = 0; lod < MAX_MESH_LODS; ++lod) {
+      profiler.setCounter(LOD_COUNTERS[lod],
+                          scene_renderer.getLodInstanceCount(lod));
+    }
+    profiler.setCounter("assets_pending", assets.getPendingCount());
+    profiler.setCounter("resolution_scale", resolution.getScale());
+    profiler.setCounter("gl_state_calls", state.getIssuedCount());
+    profiler.setCounter("gl_state_calls_skipped", state.getSkippedCount());
+    state.resetCounters();
+    profiler.endFrame();
+    if (!options.capture.empty() &&
+        profiler.getFrameCount() == options.frames) {
+      if (!captureFramebuffer(options.capture, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        std::cerr << "Unable to write: " << options.capture << '\n';
+      }
+    }
     glfwSwapBuffers(window);
+    packet = nullptr;
+  };
+
+  // Everything that touches GL runs in render_frame. With a render thread
+  // it owns the context while the loop below simulates the next frame.
+  FramePacketQueue packets;
+  std::thread render_thread;
+  if (options.render_thread) {
+    glfwMakeContextCurrent(nullptr);
+    render_thread = std::thread([&] {
+      glfwMakeContextCurrent(window);
+      while (const FramePacket *frame_packet = packets.beginRead()) {
+        render_frame(*frame_packet);
+        packets.endRead();
+      }
+      glfwMakeContextCurrent(nullptr);
+    });
+  }
+
+  uint64_t simulated_frames = 0;
+  while (!glfwWindowShouldClose(window) &&
+         (options.frames == 0 || simulated_frames < options.frames)) {
     glfwPollEvents();
+    simulate_frame(packets.beginWrite());
+    packets.endWrite();
+    ++simulated_frames;
+    if (!options.render_thread) {
+      render_frame(*packets.beginRead());
+      packets.endRead();
+    }
+  }
+
+  packets.close();
+  if (render_thread.joinable()) {
+    render_thread.join();
+    glfwMakeContextCurrent(window);
+  }
+
+  int result = EXIT_SUCCESS;
+  if (options.validate_outline) {
+    const float error =
+        validateOutline(world.ctx().at<Outline>(),
+                        world.ctx().at<Intensity>().color,
+                        getIntensityScale(world.ctx().at<Intensity>()));
+    std::cout << "Outline compute/fragment max difference: " << error << '\n';
+    profiler.setInfo("outline_validation_error", std::to_string(error));
+    if (error > OUTLINE_VALIDATION_TOLERANCE) {
+      result = EXIT_FAILURE;
+    }
+  }
+
+  if (options.validate_cpu) {
+    // The last frame's inputs go through every pass once more on the GPU
+    // and through its scalar and SSE CPU versions. Compose reads the GPU
+    // outline classes on all sides, so an outline error is not counted
+    // twice.
+    auto &outline = world.ctx().at<Outline>();
+    const auto &intensity = world.ctx().at<Intensity>();
+    const glm::vec2 intensity_scale = getIntensityScale(intensity);
+    const FloatImage intensity_image = readTextureImage(intensity.color);
+    const FloatImage history_image =
+        readTextureImage(outline.textures.next());
+    const FloatImage color_image =
+        readTextureImage(graph.getTexture(scene_color));
+    const OutlineInputs outline_inputs{outline.size, outline.history_size,
+                                       intensity_scale, frame_uniforms.time};
+    const ComposeInputs compose_inputs{
+        1.0f, getOutlineScale(outline), intensity_scale,
+        computeCircleDirections(frame_uniforms.time),
+        !options.separate_tonemap};
+
+    // The camera stays where it was, so the history is read in place like
+    // the CPU version does.
+    setOutlineCamera(outline, frame_uniforms.proj * frame_uniforms.view);
+    updateOutline(outline, intensity.color, intensity_scale);
+    packOutlineClasses(outline, graph.getTexture(outline_classes));
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT |
+                    GL_TEXTURE_FETCH_BARRIER_BIT);
+    const FloatImage gpu_outline = readTextureImage(outline.textures.current());
+    const FloatImage gpu_classes =
+        readTextureImage(graph.getTexture(outline_classes));
+
+    gl::texture_2d target;
+    target.set_storage(1, GL_RGBA32F, WINDOW_WIDTH, WINDOW_HEIGHT);
+    gl::framebuffer target_framebuffer;
+    attachRenderTargets(target_framebuffer, target, nullptr);
+    target_framebuffer.bind();
+    draw_compose(compose_inputs.zoom_amount, frame_uniforms.time,
+                 options.compose_fast_path);
+    const FloatImage gpu_compose = readTextureImage(target);
+    draw_colormapping(graph.getTexture(scene_color));
+    const FloatImage gpu_tonemap = readTextureImage(target);
+
+    const auto measure_ms = [](const auto &fn) {
+      const auto start = std::chrono::steady_clock::now();
+      fn();
+      return std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+          .count();
+    };
+    FloatImage cpu_outline;
+    FloatImage cpu_compose;
+    FloatImage cpu_tonemap;
+    const double outline_ms = measure_ms([&] {
+      updateOutlineCpu(intensity_image, history_image, outline_inputs,
+                       cpu_outline, &thread_pool);
+    });
+    const double compose_ms = measure_ms([&] {
+      composeCpu(color_image, gpu_classes, intensity_image, compose_inputs,
+                 cpu_compose, &thread_pool);
+    });
+    const double tonemap_ms = measure_ms(
+        [&] { tonemapCpu(color_image, cpu_tonemap, &thread_pool); });
+
+    const PlanarImage planar_intensity = toPlanarImage(intensity_image);
+    const PlanarImage planar_history = toPlanarImage(history_image);
+    const PlanarImage planar_color = toPlanarImage(color_image);
+    const PlanarImage planar_classes = toPlanarImage(gpu_classes);
+    PlanarImage sse_outline;
+    PlanarImage sse_compose;
+    PlanarImage sse_tonemap;
+    const double outline_sse_ms = measure_ms([&] {
+      updateOutlineSimd(planar_intensity, planar_history, outline_inputs,
+                        sse_outline, &thread_pool);
+    });
+    const double compose_sse_ms = measure_ms([&] {
+      composeSimd(planar_color, planar_classes, planar_intensity,
+                  compose_inputs, sse_compose, &thread_pool);
+    });
+    const double tonemap_sse_ms = measure_ms(
+        [&] { tonemapSimd(planar_color, sse_tonemap, &thread_pool); });
+
+    struct KernelCheck {
+      const char *name;
+      float error;
+      float tolerance;
+      double cpu_ms;
+    };
+    const KernelCheck checks[] = {
+        {"outline", getMaxDifference(cpu_outline, gpu_outline, 2),
+         CPU_OUTLINE_TOLERANCE, outline_ms},
+        {"compose", getMaxDifference(cpu_compose, gpu_compose, 3),
+         CPU_COMPOSE_TOLERANCE, compose_ms},
+        {"tonemap", getMaxDifference(cpu_tonemap, gpu_tonemap, 3),
+         CPU_TONEMAP_TOLERANCE, tonemap_ms},
+        {"outline_sse",
+         getMaxDifference(toFloatImage(sse_outline), gpu_outline, 2),
+         CPU_OUTLINE_TOLERANCE, outline_sse_ms},
+        {"compose_sse",
+         getMaxDifference(toFloatImage(sse_compose), gpu_compose, 3),
+         CPU_COMPOSE_TOLERANCE, compose_sse_ms},
+        {"tonemap_sse",
+         getMaxDifference(toFloatImage(sse_tonemap), gpu_tonemap, 3),
+         CPU_TONEMAP_TOLERANCE, tonemap_sse_ms},
+    };
+    for (const auto &check : checks) {
+      std::cout << "CPU " << check.name << ": max difference " << check.error
+                << ", " << check.cpu_ms << " ms\n";
+      const std::string prefix = std::string("cpu_") + check.name;
+      profiler.setInfo((prefix + "_error").c_str(),
+                       std::to_string(check.error));
+      profiler.setInfo((prefix + "_ms").c_str(),
+                       std::to_string(check.cpu_ms));
+      if (check.error > check.tolerance) {
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (options.compare_compose) {
+    // Both variants draw the last frame with the senses off, alternating so
+    // clock changes hit them alike. Results are read after each pair, the
+    // wait falls outside the queries.
+    std::array<GLuint, 2> queries{};
+    glGenQueries(GLsizei(queries.size()), queries.data());
+    std::array<std::vector<double>, 2> samples;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (int run = 0; run < COMPOSE_COMPARISON_RUNS; ++run) {
+      for (std::size_t variant = 0; variant < queries.size(); ++variant) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[variant]);
+        draw_compose(0.0f, frame_uniforms.time, variant == 1);
+        glEndQuery(GL_TIME_ELAPSED);
+      }
+      for (std::size_t variant = 0; variant < queries.size(); ++variant) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[variant], GL_QUERY_RESULT, &elapsed);
+        samples[variant].push_back(double(elapsed) / 1.0e6);
+      }
+    }
+    glDeleteQueries(GLsizei(queries.size()), queries.data());
+    profiler.addComparison("compose_senses_off", "full", samples[0],
+                           "fast_path", samples[1]);
+  }
+
+  profiler.setInfo("outline_mode",
+                   world.ctx().at<Outline>().mode == OutlineMode::Compute
+                       ? "compute"
+                       : "fragment");
+  profiler.flush();
+  if (!options.output.empty()) {
+    std::ofstream output(options.output);
+    if (!output) {
+      std::cerr << "Unable to write: " << options.output << '\n';
+    } else {
+      profiler.writeJson(output);
+    }
   }
 
   glfwDestroyWindow(window);
   glfwTerminate();
 
-  return 0;
+  return result;
 }
 
-void spawnScene(World &world) {
-  auto sphere_mesh = std::make_shared<Mesh>();
-  sphere_mesh->load("../assets/sphere.gltf");
+void spawnScene(World &world, AssetManager &assets) {
+  auto sphere_mesh = assets.loadMesh("../assets/sphere.gltf");
   auto sphere = world.create();
   world.emplace<MeshHandle>(sphere, sphere_mesh);
   world.emplace<Transform>(sphere, Transform({0.0f, 1.0f, 0.0}));
@@ -566,8 +1036,7 @@ void spawnScene(World &world) {
   world.emplace<Transform>(sphere_2, Transform({-1.0f, 1.0f, 2.0}));
   world.emplace<Color>(sphere_2, Color{glm::vec3(0.2f, 0.2f, 0.4f)});
 
-  auto cube_mesh = std::make_shared<Mesh>();
-  cube_mesh->load("../assets/cube.gltf");
+  auto cube_mesh = assets.loadMesh("../assets/cube.gltf");
   auto cube = world.create();
   world.emplace<MeshHandle>(cube, cube_mesh);
   world.emplace<Transform>(cube, Transform({-2.0f, 1.0f, -2.0}));
@@ -581,8 +1050,7 @@ void spawnScene(World &world) {
   world.emplace<Transform>(sphere_3, transform);
   world.emplace<Color>(sphere_3, Color{glm::vec3(0.0f, 0.6f, 0.5f)});
 
-  auto plane_mesh = std::make_shared<Mesh>();
-  plane_mesh->load("../assets/plane.gltf");
+  auto plane_mesh = assets.loadMesh("../assets/plane.gltf");
   auto plane = world.create();
   Transform plane_transform{};
   plane_transform.scale = glm::vec3(2.0f, 1.0f, 2.0f);
@@ -1,63 +1,100 @@
 #include "mesh.h"
+#include "state_cache.h"
 
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-#include <assimp/cimport.h>
+#include <algorithm>
+#include <iostream>
 
-void Mesh::load(const char* path) {
-  const aiScene* scene = aiImportFile(path, aiProcess_Triangulate);
-  if (!scene || !scene->HasMeshes()) {
+void Mesh::load(const char* path, VertexLayout layout) {
+  const auto data = loadMeshData(path, layout);
+  if (!data) {
     std::cerr << "Unable to load: " << path << '\n';
     exit(EXIT_FAILURE);
   }
+  upload(*data);
+}
 
-  const aiMesh* mesh = scene->mMeshes[0];
-  std::vector<Vertex> vertices(mesh->mNumVertices);
-  for (auto i = 0; i < mesh->mNumVertices; ++i) {
-    const aiFace& face = mesh->mFaces[i];
-    const aiVector3D v = mesh->mVertices[i];
-    const aiVector3D n = mesh->mNormals[i];
-    const aiVector3D uv = mesh->mTextureCoords[0][i];
-    vertices[i] = {
-        {v.x, v.y, v.z},
-        {n.x, n.y, n.z},
-        {uv.x, uv.y},
-    };
-  }
+void Mesh::upload(const MeshData& data) {
+  const auto vertices = data.getVertices();
+  const auto indices = data.getIndices();
 
-  std::vector<uint32_t> indices(mesh->mNumFaces * 3);
-  for (auto i = 0; i < mesh->mNumFaces; ++i) {
-    for (unsigned j = 0; j != 3; j++) {
-      indices.push_back(mesh->mFaces[i].mIndices[j]);
-    }
-  }
-  aiReleaseImport(scene);
+  StateCache::get().bindVertexArray(vao_.id());
+  index_buffer_.set_data(indices.size_bytes(), indices.data());
+  vao_.set_element_buffer(index_buffer_);
 
-  const size_t size_indices = sizeof(uint32_t) * indices.size();
-  const size_t size_vertices = sizeof(Vertex) * vertices.size();
-  index_count_ = indices.size();
+  vertex_buffer_.set_data(vertices.size_bytes(), vertices.data());
+  setupVertexArray(data.getFormat());
+  lod_count_ = data.getFormat().lod_count;
+  lods_ = data.getFormat().lods;
+  bounds_ = data.getBounds();
+}
 
-  vao_.bind();
-  index_buffer_.set_data(size_indices, indices.data());
+void Mesh::copy(const gl::buffer& source, std::size_t vertex_offset,
+                std::size_t index_offset, const MeshData& data) {
+  const std::size_t size_vertices = data.getVertices().size_bytes();
+  const std::size_t size_indices = data.getIndices().size_bytes();
+
+  index_buffer_.set_data(size_indices, nullptr);
+  glCopyNamedBufferSubData(source.id(), index_buffer_.id(), index_offset, 0,
+                           size_indices);
+  vertex_buffer_.set_data(size_vertices, nullptr);
+  glCopyNamedBufferSubData(source.id(), vertex_buffer_.id(), vertex_offset, 0,
+                           size_vertices);
+
+  StateCache::get().bindVertexArray(vao_.id());
   vao_.set_element_buffer(index_buffer_);
+  setupVertexArray(data.getFormat());
+  lod_count_ = data.getFormat().lod_count;
+  lods_ = data.getFormat().lods;
+  bounds_ = data.getBounds();
+}
 
-  vertex_buffer_.set_data(size_vertices, vertices.data());
-  vao_.set_vertex_buffer(0, vertex_buffer_, 0, sizeof(Vertex));
+void Mesh::setupVertexArray(const MeshFormat& format) {
+  index_type_ =
+      format.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  vao_.set_vertex_buffer(0, vertex_buffer_, 0, getVertexSize(format.layout));
   vao_.set_attribute_enabled(0, true);
   vao_.set_attribute_binding(0, 0);
   vao_.set_attribute_format(0, 3, GL_FLOAT, GL_FALSE, 0);
   vao_.set_attribute_enabled(1, true);
   vao_.set_attribute_binding(1, 0);
-  vao_.set_attribute_format(1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
   vao_.set_attribute_enabled(2, true);
   vao_.set_attribute_binding(2, 0);
-  vao_.set_attribute_format(2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, uv));
+  switch (format.layout) {
+  case VertexLayout::Full:
+    vao_.set_attribute_format(1, 3, GL_FLOAT, GL_FALSE,
+                              offsetof(Vertex, normal));
+    vao_.set_attribute_format(2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, uv));
+    break;
+  case VertexLayout::Compact:
+    // The octahedral normal stays two components, the shader unfolds it.
+    vao_.set_attribute_format(1, 2, GL_SHORT, GL_TRUE,
+                              offsetof(CompactVertex, normal));
+    vao_.set_attribute_format(2, 2, GL_HALF_FLOAT, GL_FALSE,
+                              offsetof(CompactVertex, uv));
+    break;
+  }
 }
 
 void Mesh::bind() {
-  vao_.bind();
+  StateCache::get().bindVertexArray(vao_.id());
+}
+
+uint32_t Mesh::getLodCount() const {
+  return lod_count_;
+}
+
+const MeshLod& Mesh::getLod(uint32_t lod) const {
+  return lods_[std::min(lod, lod_count_ - 1)];
+}
+
+GLenum Mesh::getIndexType() const {
+  return index_type_;
+}
+
+bool Mesh::isReady() const {
+  return lod_count_ != 0;
 }
 
-uint32_t Mesh::getIndexCount() const {
-  return index_count_;
+const Bounds& Mesh::getBounds() const {
+  return bounds_;
 }
@@ -1,24 +1,37 @@
 #pragma once
 
+#include "mesh_data.h"
+
 #include <glm/glm.hpp>
 #include <gl/all.hpp>
 
-struct Vertex {
-  glm::vec3 pos;
-  glm::vec3 normal;
-  glm::vec2 uv;
-};
+#include <array>
 
 class Mesh {
 public:
-  void load(const char *path);
+  void load(const char *path, VertexLayout layout = VertexLayout::Full);
+  void upload(const MeshData &data);
+  // Copies the vertices and indices of `data` that were already written to
+  // `source`.
+  void copy(const gl::buffer &source, std::size_t vertex_offset,
+            std::size_t index_offset, const MeshData &data);
   void bind();
-  uint32_t getIndexCount() const;
+  uint32_t getLodCount() const;
+  // Clamped to the coarsest LOD the mesh has
+  const MeshLod &getLod(uint32_t lod) const;
+  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+  GLenum getIndexType() const;
+  bool isReady() const;
+  const Bounds &getBounds() const;
 
 private:
+  void setupVertexArray(const MeshFormat &format);
+
   gl::vertex_array vao_{};
   gl::buffer vertex_buffer_{};
   gl::buffer index_buffer_{};
-  uint32_t index_count_{0};
+  uint32_t lod_count_{0};
+  std::array<MeshLod, MAX_MESH_LODS> lods_{};
+  GLenum index_type_{GL_UNSIGNED_INT};
+  Bounds bounds_{};
 };
-
@@ -0,0 +1,394 @@
+#include "mesh_data.h"
+#include "mesh_optimizer.h"
+
+#include <assimp/cimport.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WITCHER_SENSES_MMAP
+#endif
+
+class MappedFile {
+public:
+  static std::shared_ptr<const MappedFile> open(const std::string &path) {
+    auto file = std::shared_ptr<MappedFile>(new MappedFile());
+#ifdef WITCHER_SENSES_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    void *data = mmap(nullptr, std::size_t(info.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+    file->data_ = static_cast<const std::byte *>(data);
+    file->size_ = std::size_t(info.st_size);
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) {
+      return nullptr;
+    }
+    file->buffer_.resize(std::size_t(stream.tellg()));
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char *>(file->buffer_.data()),
+                std::streamsize(file->buffer_.size()));
+    file->data_ = file->buffer_.data();
+    file->size_ = file->buffer_.size();
+#endif
+    return file;
+  }
+
+  ~MappedFile() {
+#ifdef WITCHER_SENSES_MMAP
+    if (data_) {
+      munmap(const_cast<std::byte *>(data_), size_);
+    }
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const std::byte *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  MappedFile() = default;
+
+  const std::byte *data_{nullptr};
+  std::size_t size_{0};
+#ifndef WITCHER_SENSES_MMAP
+  std::vector<std::byte> buffer_{};
+#endif
+};
+
+namespace {
+
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t layout;
+  uint32_t vertex_size;
+  uint32_t index_size;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t lod_count;
+  uint64_t source_size;
+  int64_t source_time;
+  float bounds_center[3];
+  float bounds_radius;
+  MeshLod lods[MAX_MESH_LODS];
+};
+
+constexpr char MESH_CACHE_MAGIC[4] = {'W', 'S', 'M', 'C'};
+
+bool getSourceStamp(const char *path, uint64_t &size, int64_t &time) {
+  std::error_code error;
+  size = std::filesystem::file_size(path, error);
+  if (error) {
+    return false;
+  }
+  time = std::filesystem::last_write_time(path, error)
+             .time_since_epoch()
+             .count();
+  return !error;
+}
+
+// Maps the unit sphere onto the [-1, 1] square: the upper half directly,
+// the lower half folded over the diagonals.
+glm::vec2 encodeOctahedral(glm::vec3 normal) {
+  const float sum =
+      std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (sum == 0.0f) {
+    return glm::vec2(0.0f);
+  }
+  normal /= sum;
+  glm::vec2 encoded(normal.x, normal.y);
+  if (normal.z < 0.0f) {
+    const glm::vec2 sign(encoded.x >= 0.0f ? 1.0f : -1.0f,
+                         encoded.y >= 0.0f ? 1.0f : -1.0f);
+    encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+  }
+  return encoded;
+}
+
+template <typename T> std::vector<std::byte> toBytes(const std::vector<T> &v) {
+  std::vector<std::byte> bytes(v.size() * sizeof(T));
+  if (!bytes.empty()) {
+    std::memcpy(bytes.data(), v.data(), bytes.size());
+  }
+  return bytes;
+}
+
+} // namespace
+
+std::optional<VertexLayout> parseVertexLayout(const std::string &name) {
+  if (name == "full") {
+    return VertexLayout::Full;
+  }
+  if (name == "compact") {
+    return VertexLayout::Compact;
+  }
+  return std::nullopt;
+}
+
+const char *getVertexLayoutName(VertexLayout layout) {
+  switch (layout) {
+  case VertexLayout::Full:
+    return "full";
+  case VertexLayout::Compact:
+    return "compact";
+  }
+  return "unknown";
+}
+
+uint32_t getVertexSize(VertexLayout layout) {
+  return layout == VertexLayout::Compact ? sizeof(CompactVertex)
+                                         : sizeof(Vertex);
+}
+
+Bounds computeBounds(std::span<const Vertex> vertices) {
+  if (vertices.empty()) {
+    return {};
+  }
+  glm::vec3 min = vertices[0].pos;
+  glm::vec3 max = vertices[0].pos;
+  for (const auto &vertex : vertices) {
+    min = glm::min(min, vertex.pos);
+    max = glm::max(max, vertex.pos);
+  }
+
+  Bounds bounds;
+  bounds.center = (min + max) * 0.5f;
+  float radius_squared = 0.0f;
+  for (const auto &vertex : vertices) {
+    const glm::vec3 offset = vertex.pos - bounds.center;
+    radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+  }
+  bounds.radius = std::sqrt(radius_squared);
+  return bounds;
+}
+
+MeshData::MeshData(const std::vector<Vertex> &vertices,
+                   const std::vector<std::vector<uint32_t>> &lods,
+                   VertexLayout layout)
+    : format_{layout, 4, uint32_t(vertices.size())},
+      bounds_{computeBounds(vertices)} {
+  std::vector<uint32_t> indices;
+  for (const auto &lod : lods) {
+    if (format_.lod_count == MAX_MESH_LODS) {
+      break;
+    }
+    format_.lods[format_.lod_count++] = {uint32_t(indices.size()),
+                                         uint32_t(lod.size())};
+    indices.insert(indices.end(), lod.begin(), lod.end());
+  }
+  format_.index_count = uint32_t(indices.size());
+
+  if (layout == VertexLayout::Compact) {
+    std::vector<CompactVertex> compact(vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+      compact[i] = {vertices[i].pos,
+                    glm::packSnorm2x16(encodeOctahedral(vertices[i].normal)),
+                    glm::packHalf2x16(vertices[i].uv)};
+    }
+    vertex_storage_ = toBytes(compact);
+    if (vertices.size() <= 0x10000) {
+      format_.index_size = 2;
+    }
+  } else {
+    vertex_storage_ = toBytes(vertices);
+  }
+
+  if (format_.index_size == 2) {
+    index_storage_ =
+        toBytes(std::vector<uint16_t>(indices.begin(), indices.end()));
+  } else {
+    index_storage_ = toBytes(indices);
+  }
+  vertices_ = vertex_storage_;
+  indices_ = index_storage_;
+}
+
+MeshData::MeshData(std::shared_ptr<const MappedFile> file,
+                   const MeshFormat &format, const Bounds &bounds,
+                   std::span<const std::byte> vertices,
+                   std::span<const std::byte> indices)
+    : file_{std::move(file)}, format_{format}, bounds_{bounds},
+      vertices_{vertices}, indices_{indices} {}
+
+const MeshFormat &MeshData::getFormat() const { return format_; }
+
+const Bounds &MeshData::getBounds() const { return bounds_; }
+
+std::span<const std::byte> MeshData::getVertices() const { return vertices_; }
+
+std::span<const std::byte> MeshData::getIndices() const { return indices_; }
+
+std::optional<MeshData> importMesh(const char *path, VertexLayout layout) {
+  const aiScene *scene = aiImportFile(path, aiProcess_Triangulate);
+  if (!scene || !scene->HasMeshes()) {
+    return std::nullopt;
+  }
+
+  const aiMesh *mesh = scene->mMeshes[0];
+  std::vector<Vertex> vertices(mesh->mNumVertices);
+  for (unsigned i = 0; i < mesh->mNumVertices; ++i) {
+    const aiVector3D v = mesh->mVertices[i];
+    const aiVector3D n =
+        mesh->HasNormals() ? mesh->mNormals[i] : aiVector3D(0.0f);
+    const aiVector3D uv = mesh->HasTextureCoords(0)
+                              ? mesh->mTextureCoords[0][i]
+                              : aiVector3D(0.0f);
+    vertices[i] = {
+        {v.x, v.y, v.z},
+        {n.x, n.y, n.z},
+        {uv.x, uv.y},
+    };
+  }
+
+  std::vector<uint32_t> indices;
+  indices.reserve(mesh->mNumFaces * 3);
+  for (unsigned i = 0; i < mesh->mNumFaces; ++i) {
+    for (unsigned j = 0; j != 3; j++) {
+      indices.push_back(mesh->mFaces[i].mIndices[j]);
+    }
+  }
+  aiReleaseImport(scene);
+
+  optimizeMesh(vertices, indices);
+  return MeshData(vertices, generateLods(vertices, indices, MAX_MESH_LODS),
+                  layout);
+}
+
+std::string getMeshCachePath(const char *path) {
+  return std::string(path) + ".mesh";
+}
+
+std::optional<MeshData> readMeshCache(const char *path, VertexLayout layout) {
+  auto file = MappedFile::open(getMeshCachePath(path));
+  if (!file || file->size() < sizeof(MeshCacheHeader)) {
+    return std::nullopt;
+  }
+
+  MeshCacheHeader header{};
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != MESH_CACHE_VERSION ||
+      header.layout != uint32_t(layout) ||
+      header.vertex_size != getVertexSize(layout) ||
+      (header.index_size != 2 && header.index_size != 4) ||
+      header.lod_count == 0 || header.lod_count > MAX_MESH_LODS) {
+    return std::nullopt;
+  }
+
+  uint64_t source_size = 0;
+  int64_t source_time = 0;
+  if (getSourceStamp(path, source_size, source_time) &&
+      (source_size != header.source_size ||
+       source_time != header.source_time)) {
+    return std::nullopt;
+  }
+
+  const std::size_t vertex_bytes =
+      std::size_t(header.vertex_count) * header.vertex_size;
+  const std::size_t index_bytes =
+      std::size_t(header.index_count) * header.index_size;
+  if (file->size() != sizeof(header) + vertex_bytes + index_bytes) {
+    return std::nullopt;
+  }
+
+  MeshFormat format{layout, header.index_size, header.vertex_count,
+                    header.index_count, header.lod_count};
+  for (uint32_t i = 0; i < header.lod_count; ++i) {
+    const MeshLod &lod = header.lods[i];
+    if (uint64_t(lod.first_index) + lod.index_count > header.index_count) {
+      return std::nullopt;
+    }
+    format.lods[i] = lod;
+  }
+  Bounds bounds;
+  bounds.center = {header.bounds_center[0], header.bounds_center[1],
+                   header.bounds_center[2]};
+  bounds.radius = header.bounds_radius;
+  const std::byte *vertices = file->data() + sizeof(header);
+  const std::byte *indices = vertices + vertex_bytes;
+  return MeshData(std::move(file), format, bounds, {vertices, vertex_bytes},
+                  {indices, index_bytes});
+}
+
+bool writeMeshCache(const char *path, const MeshData &mesh) {
+  MeshCacheHeader header{};
+  std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  const MeshFormat &format = mesh.getFormat();
+  header.layout = uint32_t(format.layout);
+  header.vertex_size = getVertexSize(format.layout);
+  header.index_size = format.index_size;
+  header.vertex_count = format.vertex_count;
+  header.index_count = format.index_count;
+  header.lod_count = format.lod_count;
+  for (uint32_t i = 0; i < format.lod_count; ++i) {
+    header.lods[i] = format.lods[i];
+  }
+  const Bounds &bounds = mesh.getBounds();
+  header.bounds_center[0] = bounds.center.x;
+  header.bounds_center[1] = bounds.center.y;
+  header.bounds_center[2] = bounds.center.z;
+  header.bounds_radius = bounds.radius;
+  if (!getSourceStamp(path, header.source_size, header.source_time)) {
+    return false;
+  }
+
+  // Write to a temporary file first so a concurrent reader never maps a
+  // partially written cache.
+  const std::string cache_path = getMeshCachePath(path);
+  const std::string temp_path = cache_path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(mesh.getVertices().data()),
+              std::streamsize(mesh.getVertices().size_bytes()));
+    out.write(reinterpret_cast<const char *>(mesh.getIndices().data()),
+              std::streamsize(mesh.getIndices().size_bytes()));
+    if (!out) {
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temp_path, cache_path, error);
+  return !error;
+}
+
+std::optional<MeshData> loadMeshData(const char *path, VertexLayout layout) {
+  if (auto cached = readMeshCache(path, layout)) {
+    return cached;
+  }
+
+  auto mesh = importMesh(path, layout);
+  if (mesh && !writeMeshCache(path, *mesh)) {
+    std::cerr << "Unable to write mesh cache: " << getMeshCachePath(path)
+              << '\n';
+  }
+  return mesh;
+}
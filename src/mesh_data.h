@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+struct Vertex {
+  glm::vec3 pos;
+  glm::vec3 normal;
+  glm::vec2 uv;
+};
+
+// Vertex with the normal octahedral encoded into two snorm16 and the uv as
+// two half floats, 20 bytes instead of 32. object.vert decodes the normal
+// when built with OCTAHEDRAL_NORMALS.
+struct CompactVertex {
+  glm::vec3 pos;
+  uint32_t normal;
+  uint32_t uv;
+};
+
+// Layout of the vertex buffer. Compact meshes also use 16 bit indices when
+// they have few enough vertices.
+enum class VertexLayout : uint32_t { Full, Compact };
+
+std::optional<VertexLayout> parseVertexLayout(const std::string &name);
+const char *getVertexLayoutName(VertexLayout layout);
+uint32_t getVertexSize(VertexLayout layout);
+
+// Bounding sphere centered on the vertices' bounding box.
+struct Bounds {
+  glm::vec3 center{0.0f};
+  float radius{0.0f};
+};
+
+Bounds computeBounds(std::span<const Vertex> vertices);
+
+class MappedFile;
+
+// Index range of one level of detail. All LODs of a mesh share its vertex
+// buffer.
+struct MeshLod {
+  uint32_t first_index{0};
+  uint32_t index_count{0};
+};
+
+constexpr uint32_t MAX_MESH_LODS = 4;
+
+// Vertex and index buffer contents with what it takes to bind them
+struct MeshFormat {
+  VertexLayout layout{VertexLayout::Full};
+  // 2 or 4 bytes
+  uint32_t index_size{4};
+  uint32_t vertex_count{0};
+  // Of all LODs together
+  uint32_t index_count{0};
+  // LOD 0 is the full mesh, each further one has about half the triangles
+  uint32_t lod_count{0};
+  std::array<MeshLod, MAX_MESH_LODS> lods{};
+};
+
+// CPU side mesh in its GPU layout. Either owns its vertices and indices or
+// points into a memory-mapped mesh cache.
+class MeshData {
+public:
+  // Packs the vertices and the index lists of each LOD, finest first, into
+  // `layout`.
+  MeshData(const std::vector<Vertex> &vertices,
+           const std::vector<std::vector<uint32_t>> &lods,
+           VertexLayout layout);
+  MeshData(std::shared_ptr<const MappedFile> file, const MeshFormat &format,
+           const Bounds &bounds, std::span<const std::byte> vertices,
+           std::span<const std::byte> indices);
+
+  MeshData(const MeshData &) = delete;
+  MeshData &operator=(const MeshData &) = delete;
+  MeshData(MeshData &&) = default;
+  MeshData &operator=(MeshData &&) = default;
+
+  const MeshFormat &getFormat() const;
+  const Bounds &getBounds() const;
+  std::span<const std::byte> getVertices() const;
+  std::span<const std::byte> getIndices() const;
+
+private:
+  std::vector<std::byte> vertex_storage_{};
+  std::vector<std::byte> index_storage_{};
+  std::shared_ptr<const MappedFile> file_{};
+  MeshFormat format_{};
+  Bounds bounds_{};
+  std::span<const std::byte> vertices_{};
+  std::span<const std::byte> indices_{};
+};
+
+// Imports the first mesh of a scene file with Assimp, runs optimizeMesh()
+// on it and generates its LODs.
+std::optional<MeshData> importMesh(const char *path,
+                                   VertexLayout layout = VertexLayout::Full);
+
+// Binary mesh cache stored next to the source asset. Bump the version
+// whenever Vertex, CompactVertex or the file layout changes.
+constexpr uint32_t MESH_CACHE_VERSION = 3;
+
+std::string getMeshCachePath(const char *path);
+// Fails when the cache holds a different layout.
+std::optional<MeshData> readMeshCache(const char *path, VertexLayout layout);
+bool writeMeshCache(const char *path, const MeshData &mesh);
+
+// Returns the cached mesh for `path`, importing it and refreshing the cache
+// when the cache is missing, older than the source or in another layout.
+std::optional<MeshData> loadMeshData(const char *path,
+                                     VertexLayout layout = VertexLayout::Full);
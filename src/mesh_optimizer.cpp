@@ -0,0 +1,470 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+// A LOD has to have at most this fraction of the previous LOD's triangles
+constexpr float LOD_REDUCTION = 0.5f;
+// and at least this many triangles.
+constexpr std::size_t MIN_LOD_TRIANGLES = 8;
+
+struct VertexHash {
+  std::size_t operator()(const Vertex &vertex) const {
+    // FNV-1a over the bytes, Vertex has no padding.
+    uint64_t hash = 14695981039346656037ull;
+    const auto *bytes = reinterpret_cast<const unsigned char *>(&vertex);
+    for (std::size_t i = 0; i < sizeof(Vertex); ++i) {
+      hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return std::size_t(hash);
+  }
+};
+
+struct VertexEqual {
+  bool operator()(const Vertex &a, const Vertex &b) const {
+    return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+  }
+};
+
+// FIFO post-transform cache. A vertex is cached while fewer than `size`
+// misses happened since it was loaded.
+class CacheSimulator {
+public:
+  CacheSimulator(uint32_t vertex_count, uint32_t size)
+      : stamps_(vertex_count, 0), size_{size}, time_{size + 1} {}
+
+  bool isCached(uint32_t vertex) const {
+    return time_ - stamps_[vertex] <= size_;
+  }
+
+  // Misses since the vertex was loaded, it is evicted after `size` of them
+  uint32_t getAge(uint32_t vertex) const { return time_ - stamps_[vertex]; }
+
+  // Returns whether the vertex missed.
+  bool access(uint32_t vertex) {
+    if (isCached(vertex)) {
+      return false;
+    }
+    stamps_[vertex] = time_++;
+    return true;
+  }
+
+  uint32_t accessTriangle(const uint32_t *triangle) {
+    return uint32_t(access(triangle[0])) + uint32_t(access(triangle[1])) +
+           uint32_t(access(triangle[2]));
+  }
+
+  void clear() { time_ += size_ + 1; }
+
+private:
+  std::vector<uint32_t> stamps_;
+  uint32_t size_;
+  uint32_t time_;
+};
+
+struct Cluster {
+  uint32_t first;
+  uint32_t count;
+  float sort_key;
+};
+
+glm::vec3 getTriangleNormal(const std::vector<Vertex> &vertices,
+                            const uint32_t *triangle) {
+  const glm::vec3 a = vertices[triangle[0]].pos;
+  const glm::vec3 b = vertices[triangle[1]].pos;
+  const glm::vec3 c = vertices[triangle[2]].pos;
+  // Twice the area long
+  return glm::cross(b - a, c - a);
+}
+
+glm::vec3 getTriangleCenter(const std::vector<Vertex> &vertices,
+                            const uint32_t *triangle) {
+  return (vertices[triangle[0]].pos + vertices[triangle[1]].pos +
+          vertices[triangle[2]].pos) /
+         3.0f;
+}
+
+// Clusters start where all three vertices of a triangle miss, the cache
+// walk started over there. Each of those is split further wherever the
+// miss ratio so far is within `threshold` of the whole cluster's.
+std::vector<Cluster> findClusters(const std::vector<uint32_t> &indices,
+                                  uint32_t vertex_count, uint32_t cache_size,
+                                  float threshold) {
+  const uint32_t triangle_count = uint32_t(indices.size() / 3);
+  CacheSimulator cache(vertex_count, cache_size);
+  std::vector<uint32_t> hard_boundaries{0};
+  for (uint32_t i = 0; i < triangle_count; ++i) {
+    if (cache.accessTriangle(&indices[i * 3]) == 3 && i != 0) {
+      hard_boundaries.push_back(i);
+    }
+  }
+  hard_boundaries.push_back(triangle_count);
+
+  std::vector<Cluster> clusters;
+  for (std::size_t h = 0; h + 1 < hard_boundaries.size(); ++h) {
+    const uint32_t begin = hard_boundaries[h];
+    const uint32_t end = hard_boundaries[h + 1];
+
+    cache.clear();
+    uint32_t cluster_misses = 0;
+    for (uint32_t i = begin; i < end; ++i) {
+      cluster_misses += cache.accessTriangle(&indices[i * 3]);
+    }
+    const float cluster_threshold =
+        threshold * float(cluster_misses) / float(end - begin);
+
+    cache.clear();
+    uint32_t first = begin;
+    uint32_t misses = 0;
+    for (uint32_t i = begin; i < end; ++i) {
+      misses += cache.accessTriangle(&indices[i * 3]);
+      const uint32_t count = i + 1 - first;
+      if (float(misses) / float(count) <= cluster_threshold || i + 1 == end) {
+        clusters.push_back({first, count, 0.0f});
+        first = i + 1;
+        misses = 0;
+        cache.clear();
+      }
+    }
+  }
+  return clusters;
+}
+
+// Index of the largest component of the normal and its sign, 0 to 5.
+uint32_t getNormalBucket(const glm::vec3 &normal) {
+  const glm::vec3 magnitude = glm::abs(normal);
+  uint32_t axis = 0;
+  if (magnitude.y > magnitude[axis]) {
+    axis = 1;
+  }
+  if (magnitude.z > magnitude[axis]) {
+    axis = 2;
+  }
+  return axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                    uint32_t vertex_count,
+                                    uint32_t cache_size) {
+  if (indices.empty() || vertex_count == 0) {
+    return {};
+  }
+  CacheSimulator cache(vertex_count, cache_size);
+  uint32_t misses = 0;
+  for (const uint32_t index : indices) {
+    misses += uint32_t(cache.access(index));
+  }
+  return {float(misses) / float(indices.size() / 3),
+          float(misses) / float(vertex_count)};
+}
+
+void deduplicateVertices(std::vector<Vertex> &vertices,
+                         std::vector<uint32_t> &indices) {
+  std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> unique;
+  unique.reserve(vertices.size());
+  std::vector<uint32_t> remap(vertices.size(), NO_VERTEX);
+  std::vector<Vertex> merged;
+  merged.reserve(vertices.size());
+  for (auto &index : indices) {
+    if (remap[index] == NO_VERTEX) {
+      const auto [it, inserted] =
+          unique.try_emplace(vertices[index], uint32_t(merged.size()));
+      if (inserted) {
+        merged.push_back(vertices[index]);
+      }
+      remap[index] = it->second;
+    }
+    index = remap[index];
+  }
+  vertices = std::move(merged);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertex_count,
+                         uint32_t cache_size) {
+  const uint32_t triangle_count = uint32_t(indices.size() / 3);
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // Triangles around each vertex, and how many of them are not emitted yet
+  std::vector<uint32_t> live(vertex_count, 0);
+  for (const uint32_t index : indices) {
+    ++live[index];
+  }
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    offsets[v + 1] = offsets[v] + live[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < indices.size(); ++i) {
+      adjacency[fill[indices[i]]++] = i / 3;
+    }
+  }
+
+  CacheSimulator cache(vertex_count, cache_size);
+  std::vector<bool> emitted(triangle_count, false);
+  // Recently touched vertices to continue from at a dead end
+  std::vector<uint32_t> dead_ends;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  // Next vertex to try once the dead end stack runs out
+  uint32_t cursor = 0;
+
+  uint32_t fanning = indices[0];
+  while (fanning != NO_VERTEX) {
+    candidates.clear();
+    for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+      const uint32_t triangle = adjacency[a];
+      if (emitted[triangle]) {
+        continue;
+      }
+      for (uint32_t j = 0; j < 3; ++j) {
+        const uint32_t v = indices[triangle * 3 + j];
+        result.push_back(v);
+        dead_ends.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        cache.access(v);
+      }
+      emitted[triangle] = true;
+    }
+
+    // Prefer the vertex that entered the cache first among those whose
+    // remaining triangles still fit before it is evicted. Any vertex with
+    // triangles left beats the dead end stack, even at priority 0.
+    uint32_t next = NO_VERTEX;
+    uint32_t best_priority = 0;
+    for (const uint32_t v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      uint32_t priority = 0;
+      if (cache.getAge(v) + 2 * live[v] <= cache_size) {
+        priority = cache.getAge(v);
+      }
+      if (next == NO_VERTEX || priority > best_priority) {
+        best_priority = priority;
+        next = v;
+      }
+    }
+
+    if (next == NO_VERTEX) {
+      while (!dead_ends.empty() && next == NO_VERTEX) {
+        const uint32_t v = dead_ends.back();
+        dead_ends.pop_back();
+        if (live[v] > 0) {
+          next = v;
+        }
+      }
+      for (; cursor < vertex_count && next == NO_VERTEX; ++cursor) {
+        if (live[cursor] > 0) {
+          next = cursor;
+        }
+      }
+    }
+    fanning = next;
+  }
+  indices = std::move(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices,
+                      const std::vector<Vertex> &vertices,
+                      uint32_t cache_size, float threshold) {
+  if (indices.empty()) {
+    return;
+  }
+  auto clusters =
+      findClusters(indices, uint32_t(vertices.size()), cache_size, threshold);
+
+  // Area weighted center of the mesh
+  glm::vec3 mesh_center(0.0f);
+  float mesh_area = 0.0f;
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    const float area = glm::length(getTriangleNormal(vertices, &indices[i]));
+    mesh_center += getTriangleCenter(vertices, &indices[i]) * area;
+    mesh_area += area;
+  }
+  mesh_center /= std::max(mesh_area, std::numeric_limits<float>::min());
+
+  // Clusters whose average normal points away from the center face the
+  // viewer whenever the ones behind them do.
+  for (auto &cluster : clusters) {
+    glm::vec3 center(0.0f);
+    glm::vec3 normal(0.0f);
+    float area = 0.0f;
+    for (uint32_t t = cluster.first; t < cluster.first + cluster.count; ++t) {
+      const glm::vec3 triangle_normal =
+          getTriangleNormal(vertices, &indices[t * 3]);
+      const float triangle_area = glm::length(triangle_normal);
+      center += getTriangleCenter(vertices, &indices[t * 3]) * triangle_area;
+      normal += triangle_normal;
+      area += triangle_area;
+    }
+    const float normal_length = glm::length(normal);
+    if (area > 0.0f && normal_length > 0.0f) {
+      cluster.sort_key =
+          glm::dot(center / area - mesh_center, normal / normal_length);
+    }
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sort_key > b.sort_key;
+                   });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (const auto &cluster : clusters) {
+    result.insert(result.end(), indices.begin() + cluster.first * 3,
+                  indices.begin() + (cluster.first + cluster.count) * 3);
+  }
+  indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::vector<uint32_t> &indices) {
+  std::vector<uint32_t> remap(vertices.size(), NO_VERTEX);
+  std::vector<Vertex> ordered;
+  ordered.reserve(vertices.size());
+  for (auto &index : indices) {
+    if (remap[index] == NO_VERTEX) {
+      remap[index] = uint32_t(ordered.size());
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(ordered);
+}
+
+void optimizeMesh(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) {
+  deduplicateVertices(vertices, indices);
+  optimizeVertexCache(indices, uint32_t(vertices.size()));
+  optimizeOverdraw(indices, vertices);
+  optimizeVertexFetch(vertices, indices);
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> &vertices,
+                                   const std::vector<uint32_t> &indices,
+                                   uint32_t grid_size) {
+  if (indices.empty() || grid_size == 0) {
+    return {};
+  }
+  glm::vec3 min = vertices[indices[0]].pos;
+  glm::vec3 max = min;
+  for (const uint32_t index : indices) {
+    min = glm::min(min, vertices[index].pos);
+    max = glm::max(max, vertices[index].pos);
+  }
+  const glm::vec3 extent = max - min;
+  const float longest = std::max({extent.x, extent.y, extent.z});
+  const float cell_scale =
+      longest > 0.0f ? float(grid_size) / longest : 0.0f;
+
+  struct Cell {
+    glm::vec3 position_sum{0.0f};
+    uint32_t vertex_count{0};
+    uint32_t representative{NO_VERTEX};
+    float distance{0.0f};
+  };
+  std::unordered_map<uint64_t, uint32_t> cell_ids;
+  std::vector<Cell> cells;
+  std::vector<uint32_t> vertex_cells(vertices.size(), NO_VERTEX);
+  for (const uint32_t index : indices) {
+    if (vertex_cells[index] != NO_VERTEX) {
+      continue;
+    }
+    const glm::vec3 cell = (vertices[index].pos - min) * cell_scale;
+    const auto clampCell = [grid_size](float value) {
+      return std::min(uint64_t(value), uint64_t(grid_size - 1));
+    };
+    const uint64_t key = clampCell(cell.x) |
+                         clampCell(cell.y) << 20 | clampCell(cell.z) << 40 |
+                         uint64_t(getNormalBucket(vertices[index].normal))
+                             << 60;
+    const auto [it, inserted] = cell_ids.try_emplace(key, cells.size());
+    if (inserted) {
+      cells.emplace_back();
+    }
+    vertex_cells[index] = it->second;
+    cells[it->second].position_sum += vertices[index].pos;
+    ++cells[it->second].vertex_count;
+  }
+
+  // The vertex closest to the average of its cell stands in for the cell,
+  // so no new vertices are needed.
+  for (std::size_t v = 0; v < vertices.size(); ++v) {
+    if (vertex_cells[v] == NO_VERTEX) {
+      continue;
+    }
+    auto &cell = cells[vertex_cells[v]];
+    const glm::vec3 offset =
+        vertices[v].pos - cell.position_sum / float(cell.vertex_count);
+    const float distance = glm::dot(offset, offset);
+    if (cell.representative == NO_VERTEX || distance < cell.distance) {
+      cell.representative = uint32_t(v);
+      cell.distance = distance;
+    }
+  }
+
+  std::vector<uint32_t> result;
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    const uint32_t a = cells[vertex_cells[indices[i]]].representative;
+    const uint32_t b = cells[vertex_cells[indices[i + 1]]].representative;
+    const uint32_t c = cells[vertex_cells[indices[i + 2]]].representative;
+    if (a != b && b != c && c != a) {
+      result.insert(result.end(), {a, b, c});
+    }
+  }
+  return result;
+}
+
+std::vector<std::vector<uint32_t>>
+generateLods(const std::vector<Vertex> &vertices,
+             const std::vector<uint32_t> &indices, uint32_t max_lods) {
+  std::vector<std::vector<uint32_t>> lods;
+  lods.push_back(indices);
+  // Grids finer than one cell per vertex leave the mesh as it is, and cell
+  // coordinates have 20 bits.
+  uint32_t grid_size =
+      uint32_t(std::min(vertices.size(), std::size_t(1) << 20));
+  while (lods.size() < max_lods) {
+    const std::size_t target = std::size_t(float(lods.back().size() / 3) *
+                                           LOD_REDUCTION);
+    if (target < MIN_LOD_TRIANGLES) {
+      break;
+    }
+
+    // Finest grid that reaches the target, the triangle count shrinks
+    // with the grid for all practical purposes.
+    uint32_t low = 1;
+    uint32_t high = grid_size;
+    std::vector<uint32_t> best;
+    while (low <= high) {
+      const uint32_t middle = low + (high - low) / 2;
+      auto simplified = simplifyMesh(vertices, indices, middle);
+      if (simplified.size() / 3 <= target) {
+        best = std::move(simplified);
+        grid_size = middle;
+        low = middle + 1;
+      } else {
+        high = middle - 1;
+      }
+    }
+    if (best.size() / 3 < MIN_LOD_TRIANGLES) {
+      break;
+    }
+    optimizeVertexCache(best, uint32_t(vertices.size()));
+    lods.push_back(std::move(best));
+  }
+  return lods;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "mesh_data.h"
+
+#include <cstdint>
+#include <vector>
+
+// Import-time reordering of triangle lists. Each step keeps the rendered
+// triangles and their winding and only changes the order and the vertex
+// numbering, so the steps can run in sequence as optimizeMesh() does.
+
+// Entries of the simulated post-transform cache, FIFO like most hardware
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+  // Average cache misses per triangle, 0.5 is the ideal for a large grid
+  float acmr{0.0f};
+  // Average transforms per vertex, 1 when no vertex is shaded twice
+  float atvr{0.0f};
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                    uint32_t vertex_count,
+                                    uint32_t cache_size = VERTEX_CACHE_SIZE);
+
+// Merges bitwise identical vertices and drops the unreferenced ones.
+void deduplicateVertices(std::vector<Vertex> &vertices,
+                         std::vector<uint32_t> &indices);
+
+// Orders triangles for the post-transform cache with Tipsify (Sander et
+// al. 2007): fans around the most recently cached vertex that still has
+// triangles left.
+void optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertex_count,
+                         uint32_t cache_size = VERTEX_CACHE_SIZE);
+
+// Splits cache ordered triangles into clusters, where the cache starts over
+// or restarting it costs at most `threshold` times the cluster's miss
+// ratio, and draws the clusters facing away from the mesh center first so
+// they hide the ones behind them.
+void optimizeOverdraw(std::vector<uint32_t> &indices,
+                      const std::vector<Vertex> &vertices,
+                      uint32_t cache_size = VERTEX_CACHE_SIZE,
+                      float threshold = 1.05f);
+
+// Renumbers vertices in the order the indices first use them, so vertex
+// fetch walks the buffer forward.
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::vector<uint32_t> &indices);
+
+// All of the above in order.
+void optimizeMesh(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices);
+
+// Vertex clustering (Rossignac and Borrel 1993): snaps the vertices to a
+// grid with `grid_size` cells along the longest side of the bounding box
+// and keeps one vertex per cell and normal direction, so hard edges stay
+// apart. Triangles that collapse are dropped. The result indexes the same
+// vertices, simplified LODs share the vertex buffer of the full mesh.
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> &vertices,
+                                   const std::vector<uint32_t> &indices,
+                                   uint32_t grid_size);
+
+// Index lists of up to `max_lods` LODs from `indices` on, each with about
+// half the triangles of the previous one and ordered for the vertex cache.
+// Stops early once the grid can't remove enough triangles.
+std::vector<std::vector<uint32_t>>
+generateLods(const std::vector<Vertex> &vertices,
+             const std::vector<uint32_t> &indices, uint32_t max_lods);
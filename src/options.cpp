@@ -0,0 +1,190 @@
+#include "options.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+void printUsage(const char *program) {
+  std::cerr << "Usage: " << program << " [options]\n"
+            << "  --frames <n>       render n frames and exit\n"
+            << "  --output <file>    write frame timings as JSON\n"
+            << "  --hidden           render into a hidden window\n"
+            << "  --null-platform    use the GLFW null platform (EGL surfaceless)\n"
+            << "  --fixed-dt <sec>   advance time by a fixed step every frame\n"
+            << "  --real-clock       use wall-clock time\n"
+            << "  --tick-rate <hz>   simulation steps per second\n"
+            << "  --outline-compute  run the outline pass as a compute shader\n"
+            << "  --no-outline-reprojection\n"
+            << "                     read the outline history in place\n"
+            << "  --validate-outline compare compute and fragment outline passes\n"
+            << "  --validate-cpu     compare post-processing with the CPU kernels\n"
+            << "  --stencil-mask     build the intensity mask with one compute pass\n"
+            << "  --intensity-falloff <constant|linear|smooth|inverse-square>\n"
+            << "                     fade of trace intensity with distance\n"
+            << "  --intensity-max-distance <m>\n"
+            << "                     distance beyond which clues are not shown\n"
+            << "  --frame-budget <ms>\n"
+            << "                     scale outline and intensity resolution to\n"
+            << "                     keep the GPU frame time within <ms>\n"
+            << "  --resolution-scale <s>\n"
+            << "                     outline and intensity resolution (0-1]\n"
+            << "  --depth-prepass    draw depth and stencil before the lit pass\n"
+            << "  --no-render-thread simulate and render on the main thread\n"
+            << "  --culling <off|cpu|gpu>\n"
+            << "                     frustum culling of scene instances\n"
+            << "  --mesh-layout <full|compact>\n"
+            << "                     vertex format meshes are loaded in\n"
+            << "  --lod-screen-size <s>\n"
+            << "                     screen height fraction below which meshes\n"
+            << "                     use simplified LODs, 0 disables LODs\n"
+            << "  --target-preset <full|half|compact>\n"
+            << "                     render target formats for color and hdr\n"
+            << "  --color-format <f> override the scene color format\n"
+            << "  --hdr-format <f>   override the composed hdr format\n"
+            << "  --capture <file>   write the last frame as PPM\n"
+            << "  --shader-cache <dir>\n"
+            << "                     directory for linked program binaries\n"
+            << "  --no-shader-cache  compile every program from source\n"
+            << "  --no-watch-shaders don't reload shaders when they are saved\n"
+            << "  --separate-tonemap tonemap in its own pass (debugging)\n"
+            << "  --senses           keep witcher senses enabled\n"
+            << "  --sense-radius <m> tag clues within <m> of the camera\n"
+            << "  --no-compose-fast-path\n"
+            << "                     always run the full compose shader\n"
+            << "  --compare-compose  time compose against its fast path\n"
+            << "  --no-compare-compose\n"
+            << "                     skip the compose comparison (bench)\n";
+}
+
+const char *nextArg(int argc, char **argv, int &i) {
+  if (i + 1 >= argc) {
+    std::cerr << "Missing value for " << argv[i] << '\n';
+    printUsage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  return argv[++i];
+}
+
+} // namespace
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+#ifdef WITCHER_SENSES_BENCH
+  options.hidden_window = true;
+  options.deterministic_clock = true;
+  options.frames = 1000;
+  options.output = "bench.json";
+  options.watch_shaders = false;
+  options.compare_compose = true;
+#endif
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (std::strcmp(arg, "--frames") == 0) {
+      options.frames = std::strtoull(nextArg(argc, argv, i), nullptr, 10);
+    } else if (std::strcmp(arg, "--output") == 0) {
+      options.output = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--hidden") == 0) {
+      options.hidden_window = true;
+    } else if (std::strcmp(arg, "--null-platform") == 0) {
+      options.hidden_window = true;
+      options.null_platform = true;
+    } else if (std::strcmp(arg, "--fixed-dt") == 0) {
+      options.deterministic_clock = true;
+      options.fixed_dt = std::strtod(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--real-clock") == 0) {
+      options.deterministic_clock = false;
+    } else if (std::strcmp(arg, "--tick-rate") == 0) {
+      options.tick_rate = std::strtod(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--outline-compute") == 0) {
+      options.outline_compute = true;
+    } else if (std::strcmp(arg, "--no-outline-reprojection") == 0) {
+      options.outline_reprojection = false;
+    } else if (std::strcmp(arg, "--validate-outline") == 0) {
+      options.validate_outline = true;
+    } else if (std::strcmp(arg, "--validate-cpu") == 0) {
+      options.validate_cpu = true;
+    } else if (std::strcmp(arg, "--stencil-mask") == 0) {
+      options.stencil_mask = true;
+    } else if (std::strcmp(arg, "--intensity-falloff") == 0) {
+      options.intensity_falloff = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--intensity-max-distance") == 0) {
+      options.intensity_max_distance =
+          std::strtof(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--frame-budget") == 0) {
+      options.frame_budget_ms = std::strtod(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--resolution-scale") == 0) {
+      options.resolution_scale =
+          std::strtof(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--depth-prepass") == 0) {
+      options.depth_prepass = true;
+    } else if (std::strcmp(arg, "--no-render-thread") == 0) {
+      options.render_thread = false;
+    } else if (std::strcmp(arg, "--culling") == 0) {
+      options.culling = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--mesh-layout") == 0) {
+      options.mesh_layout = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--lod-screen-size") == 0) {
+      options.lod_screen_size = std::strtof(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--target-preset") == 0) {
+      options.target_preset = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--color-format") == 0) {
+      options.color_format = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--hdr-format") == 0) {
+      options.hdr_format = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--separate-tonemap") == 0) {
+      options.separate_tonemap = true;
+    } else if (std::strcmp(arg, "--senses") == 0) {
+      options.senses = true;
+    } else if (std::strcmp(arg, "--sense-radius") == 0) {
+      options.sense_radius = std::strtof(nextArg(argc, argv, i), nullptr);
+    } else if (std::strcmp(arg, "--no-compose-fast-path") == 0) {
+      options.compose_fast_path = false;
+    } else if (std::strcmp(arg, "--compare-compose") == 0) {
+      options.compare_compose = true;
+    } else if (std::strcmp(arg, "--no-compare-compose") == 0) {
+      options.compare_compose = false;
+    } else if (std::strcmp(arg, "--shader-cache") == 0) {
+      options.shader_cache = nextArg(argc, argv, i);
+    } else if (std::strcmp(arg, "--no-shader-cache") == 0) {
+      options.shader_cache.clear();
+    } else if (std::strcmp(arg, "--no-watch-shaders") == 0) {
+      options.watch_shaders = false;
+    } else if (std::strcmp(arg, "--capture") == 0) {
+      options.capture = nextArg(argc, argv, i);
+    } else {
+      std::cerr << "Unknown option: " << arg << '\n';
+      printUsage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options.tick_rate <= 0.0 || options.fixed_dt <= 0.0) {
+    std::cerr << "--tick-rate and --fixed-dt must be positive\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (options.sense_radius <= 0.0f) {
+    std::cerr << "--sense-radius must be positive\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (options.intensity_max_distance <= 0.0f) {
+    std::cerr << "--intensity-max-distance must be positive\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (options.resolution_scale <= 0.0f || options.resolution_scale > 1.0f) {
+    std::cerr << "--resolution-scale must be in (0, 1]\n";
+    exit(EXIT_FAILURE);
+  }
+
+  if (!options.capture.empty() && options.frames == 0) {
+    std::cerr << "--capture requires --frames\n";
+    exit(EXIT_FAILURE);
+  }
+
+  return options;
+}
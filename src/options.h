@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct Options {
+  bool hidden_window{false};
+  bool null_platform{false};
+  bool deterministic_clock{false};
+  // Frame time advanced per frame by the deterministic clock
+  double fixed_dt{1.0 / 60.0};
+  // Simulation steps per second
+  double tick_rate{60.0};
+  // 0 means run until the window is closed
+  uint64_t frames{0};
+  std::string output{};
+  bool outline_compute{false};
+  // Moves the outline history along with the camera
+  bool outline_reprojection{true};
+  // Builds the intensity mask at outline resolution from the stencil buffer
+  bool stencil_mask{false};
+  // Tonemaps in a separate pass over an hdr target instead of in compose
+  bool separate_tonemap{false};
+  // Holds the senses key from the first frame
+  bool senses{false};
+  // Distance from the camera within which clues are tagged
+  float sense_radius{20.0f};
+  // Replaces compose with a copy while the senses effect is invisible
+  bool compose_fast_path{true};
+  // Times compose with the senses off through the full shader and the fast
+  // path after the last frame
+  bool compare_compose{false};
+  // Lays down depth and stencil first and shades with GL_EQUAL
+  bool depth_prepass{false};
+  // GPU frame time the outline and intensity resolution is adjusted to, 0
+  // keeps them at resolution_scale
+  double frame_budget_ms{0.0};
+  // Largest outline and intensity resolution as a fraction of their full size
+  float resolution_scale{1.0f};
+  // Submits GL from its own thread while the next frame is simulated
+  bool render_thread{true};
+  // Fade of trace intensity with distance: constant, linear, smooth or
+  // inverse-square
+  std::string intensity_falloff{"smooth"};
+  // Tagged pixels further from the camera get no intensity
+  float intensity_max_distance{30.0f};
+  // Frustum culling of scene instances: off, cpu or gpu
+  std::string culling{"gpu"};
+  // Vertex format of meshes: full, or compact with octahedral normals, half
+  // float uvs and 16 bit indices
+  std::string mesh_layout{"full"};
+  // Projected size as a fraction of the screen height below which meshes
+  // switch to simplified LODs, 0 always draws the full meshes
+  float lod_screen_size{0.25f};
+  // Render target formats, see render_targets.h
+  std::string target_preset{"full"};
+  std::string color_format{};
+  std::string hdr_format{};
+  // Writes the last frame as PPM, requires --frames
+  std::string capture{};
+  // Directory linked programs are cached in, empty disables the cache
+  std::string shader_cache{"shader_cache"};
+  // Rebuilds programs when their sources are saved
+  bool watch_shaders{true};
+  // Compares the compute and fragment outline passes after the last frame
+  bool validate_outline{false};
+  // Compares outline, compose and tonemap against their CPU versions after
+  // the last frame
+  bool validate_cpu{false};
+};
+
+Options parseOptions(int argc, char **argv);
@@ -0,0 +1,188 @@
+#include "outline.h"
+#include "state_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr int OUTLINE_TILE_SIZE = 16;
+
+constexpr Uniform<int, "intensity_map"> INTENSITY_MAP;
+constexpr Uniform<int, "outline_map"> OUTLINE_MAP;
+constexpr Uniform<int, "depth_map"> DEPTH_MAP;
+constexpr Uniform<int, "reproject"> REPROJECT;
+constexpr Uniform<glm::mat4, "inv_view_proj"> INV_VIEW_PROJ;
+constexpr Uniform<glm::mat4, "history_view_proj"> HISTORY_VIEW_PROJ;
+constexpr Uniform<glm::vec2, "outline_texel_size"> OUTLINE_TEXEL_SIZE;
+constexpr Uniform<int, "outline_size"> OUTLINE_ACTIVE_SIZE;
+constexpr Uniform<glm::vec2, "intensity_scale"> INTENSITY_SCALE;
+constexpr Uniform<glm::vec2, "history_scale"> HISTORY_SCALE;
+constexpr int MIN_OUTLINE_SIZE = 128;
+
+gl::texture_2d createOutlineTexture() {
+  gl::texture_2d texture;
+  texture.set_min_filter(GL_LINEAR);
+  texture.set_mag_filter(GL_LINEAR);
+  texture.set_wrap_s(GL_REPEAT);
+  texture.set_wrap_t(GL_REPEAT);
+  texture.set_storage(1, GL_RGBA16F, OUTLINE_SIZE, OUTLINE_SIZE);
+  return texture;
+}
+
+void setScales(Shader &shader, const Outline &outline,
+               glm::vec2 intensity_scale) {
+  shader.set(OUTLINE_TEXEL_SIZE, glm::vec2(1.0f / float(outline.size)));
+  shader.set(INTENSITY_SCALE, intensity_scale);
+  shader.set(HISTORY_SCALE,
+             glm::vec2(float(outline.history_size) / float(OUTLINE_SIZE)));
+  shader.set(REPROJECT, outline.reproject ? 1 : 0);
+  shader.set(INV_VIEW_PROJ, glm::inverse(outline.view_proj));
+  shader.set(HISTORY_VIEW_PROJ, outline.history_view_proj);
+}
+
+void runFragment(Outline &outline, const gl::texture_2d &intensity,
+                 glm::vec2 intensity_scale, const gl::texture_2d &history,
+                 const gl::texture_2d &target) {
+  auto &state = StateCache::get();
+  outline.framebuffer.bind();
+  outline.framebuffer.attach_texture(GL_COLOR_ATTACHMENT0, target);
+  outline.shader.use();
+  setScales(outline.shader, outline, intensity_scale);
+  gl::set_viewport({0, 0}, {outline.size, outline.size});
+  state.bindTextureUnit(0, intensity.id());
+  state.bindTextureUnit(1, history.id());
+  outline.depth_view.bind_unit(2);
+  state.bindVertexArray(outline.vao.id());
+  gl::clear(GL_COLOR_BUFFER_BIT);
+  gl::draw_arrays(GL_TRIANGLES, 0, 6);
+}
+
+void runCompute(Outline &outline, const gl::texture_2d &intensity,
+                glm::vec2 intensity_scale, const gl::texture_2d &history,
+                const gl::texture_2d &target) {
+  auto &state = StateCache::get();
+  outline.compute_shader.use();
+  setScales(outline.compute_shader, outline, intensity_scale);
+  outline.compute_shader.set(OUTLINE_ACTIVE_SIZE, outline.size);
+  state.bindTextureUnit(0, intensity.id());
+  state.bindTextureUnit(1, history.id());
+  outline.depth_view.bind_unit(2);
+  glBindImageTexture(0, target.id(), 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                     GL_RGBA16F);
+  const GLuint groups =
+      GLuint(outline.size + OUTLINE_TILE_SIZE - 1) / OUTLINE_TILE_SIZE;
+  glDispatchCompute(groups, groups, 1);
+}
+
+std::vector<float> readOutline(const gl::texture_2d &texture) {
+  std::vector<float> pixels(2 * OUTLINE_SIZE * OUTLINE_SIZE);
+  glGetTextureImage(texture.id(), 0, GL_RG, GL_FLOAT,
+                    GLsizei(pixels.size() * sizeof(float)), pixels.data());
+  return pixels;
+}
+
+} // namespace
+
+void createOutline(World &world, OutlineMode mode,
+                   const gl::texture_2d &depth_stencil,
+                   ProgramRegistry &programs) {
+  gl::texture_2d color_1 = createOutlineTexture();
+  gl::texture_2d color_2 = createOutlineTexture();
+
+  gl::framebuffer framebuffer;
+  framebuffer.attach_texture(GL_COLOR_ATTACHMENT0, color_1, 0);
+  framebuffer.set_draw_buffer(GL_COLOR_ATTACHMENT0);
+
+  Shader shader =
+      programs.load({"../assets/outline.vert", "../assets/outline.frag"});
+  shader.set(INTENSITY_MAP, 0);
+  shader.set(OUTLINE_MAP, 1);
+  shader.set(DEPTH_MAP, 2);
+
+  Shader compute_shader = programs.load({"../assets/outline.comp"});
+  compute_shader.set(INTENSITY_MAP, 0);
+  compute_shader.set(OUTLINE_MAP, 1);
+  compute_shader.set(DEPTH_MAP, 2);
+
+  Shader pack_shader = programs.load({"../assets/outline_pack.comp"});
+  pack_shader.set(OUTLINE_MAP, 0);
+
+  auto &outline = world.ctx().emplace<Outline>(
+      std::move(framebuffer),
+      PingPong({std::move(color_1), std::move(color_2)}), std::move(shader),
+      std::move(compute_shader), std::move(pack_shader),
+      DepthStencilView(depth_stencil, GL_DEPTH_COMPONENT));
+  outline.mode = mode;
+}
+
+void setOutlineCamera(Outline &outline, const glm::mat4 &view_proj) {
+  outline.history_view_proj =
+      outline.has_camera ? outline.view_proj : view_proj;
+  outline.view_proj = view_proj;
+  outline.has_camera = true;
+}
+
+void setOutlineScale(Outline &outline, float scale) {
+  const int tiles = int(std::lround(float(OUTLINE_SIZE) * scale /
+                                    float(OUTLINE_TILE_SIZE)));
+  outline.size =
+      std::clamp(tiles * OUTLINE_TILE_SIZE, MIN_OUTLINE_SIZE, OUTLINE_SIZE);
+}
+
+glm::vec2 getOutlineScale(const Outline &outline) {
+  return glm::vec2(float(outline.size) / float(OUTLINE_SIZE));
+}
+
+void updateOutline(Outline &outline, const gl::texture_2d &intensity,
+                   glm::vec2 intensity_scale) {
+  if (outline.mode == OutlineMode::Compute) {
+    runCompute(outline, intensity, intensity_scale, outline.textures.next(),
+               outline.textures.current());
+  } else {
+    runFragment(outline, intensity, intensity_scale, outline.textures.next(),
+                outline.textures.current());
+  }
+  outline.history_size = outline.size;
+}
+
+void packOutlineClasses(Outline &outline, const gl::texture_2d &classes) {
+  if (outline.mode == OutlineMode::Compute) {
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+  outline.pack_shader.use();
+  outline.pack_shader.set(OUTLINE_ACTIVE_SIZE, outline.size);
+  StateCache::get().bindTextureUnit(0, outline.textures.current().id());
+  glBindImageTexture(0, classes.id(), 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                     GL_RG16F);
+  const GLuint groups = GLuint(outline.size / 2 + OUTLINE_TILE_SIZE - 1) /
+                        OUTLINE_TILE_SIZE;
+  glDispatchCompute(groups, groups, 1);
+}
+
+float validateOutline(Outline &outline, const gl::texture_2d &intensity,
+                      glm::vec2 intensity_scale) {
+  const gl::texture_2d fragment_target = createOutlineTexture();
+  const gl::texture_2d compute_target = createOutlineTexture();
+  runFragment(outline, intensity, intensity_scale, outline.textures.next(),
+              fragment_target);
+  runCompute(outline, intensity, intensity_scale, outline.textures.next(),
+             compute_target);
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+  outline.framebuffer.attach_texture(GL_COLOR_ATTACHMENT0,
+                                     outline.textures.current());
+
+  const auto expected = readOutline(fragment_target);
+  const auto actual = readOutline(compute_target);
+  // Only the active part of the targets is written by both passes.
+  float max_error = 0.0f;
+  for (int y = 0; y < outline.size; ++y) {
+    for (int x = 0; x < 2 * outline.size; ++x) {
+      const std::size_t i = std::size_t(y) * 2 * OUTLINE_SIZE + x;
+      max_error = std::max(max_error, std::abs(expected[i] - actual[i]));
+    }
+  }
+  return max_error;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "components.h"
+#include "intensity.h"
+#include "program_registry.h"
+#include "shader.h"
+
+#include <gl/all.hpp>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+
+// Allocated size of the outline textures. The simulation runs on the
+// bottom-left size x size texels, see setOutlineScale().
+constexpr int OUTLINE_SIZE = 512;
+// Texels per side of the RG16F texture packOutlineClasses() writes
+constexpr int OUTLINE_CLASSES_SIZE = OUTLINE_SIZE / 2;
+
+enum class OutlineMode {
+  Fragment,
+  Compute,
+};
+
+class PingPong {
+public:
+  PingPong(std::array<gl::texture_2d, 2> &&textures)
+      : textures_{std::move(textures)} {}
+
+  void swap() { current_index_ = 1 - current_index_; }
+
+  const gl::texture_2d &current() const { return textures_[current_index_]; }
+
+  const gl::texture_2d &next() const { return textures_[1 - current_index_]; }
+
+private:
+  std::array<gl::texture_2d, 2> textures_;
+  uint32_t current_index_ = 0;
+};
+
+// The outline holds the screen four times, once per quadrant, see
+// outline.frag. Its red and green channels are the propagated glow, blue is
+// the view depth of the screen pixel the texel was computed for.
+struct Outline {
+  gl::framebuffer framebuffer;
+  PingPong textures;
+  Shader shader;
+  Shader compute_shader;
+  Shader pack_shader;
+  // Scene depth, to reproject the history
+  DepthStencilView depth_view;
+  gl::vertex_array vao{};
+  OutlineMode mode{OutlineMode::Fragment};
+  int size{OUTLINE_SIZE};
+  // Size the history in textures.next() was written at
+  int history_size{OUTLINE_SIZE};
+  // Follows the history to where the camera moved it. Otherwise it is read
+  // at the same uv and the glow smears across the screen.
+  bool reproject{true};
+  // Camera of the next update and of the history, see setOutlineCamera()
+  glm::mat4 view_proj{1.0f};
+  glm::mat4 history_view_proj{1.0f};
+  bool has_camera{false};
+};
+
+void createOutline(World &world, OutlineMode mode,
+                   const gl::texture_2d &depth_stencil,
+                   ProgramRegistry &programs);
+
+// Sets the camera of the next update. The history was written with the
+// camera of the previous call, the first call and two calls with the same
+// camera don't move it.
+void setOutlineCamera(Outline &outline, const glm::mat4 &view_proj);
+
+// Runs the next updates on OUTLINE_SIZE * scale texels, rounded to whole
+// compute tiles. The history is resampled, so the scale can change every
+// frame.
+void setOutlineScale(Outline &outline, float scale);
+// Part of the outline textures holding the current state, in uv.
+glm::vec2 getOutlineScale(const Outline &outline);
+
+// Writes the next outline state into textures.current(), reading the
+// previous one from textures.next(). With reproject, each history sample is
+// moved along the camera motion using the scene depth. Samples whose pixel
+// was off screen or hidden in the previous frame start over at zero. The
+// noise is driven by the time in the per-frame uniform block.
+// `intensity_scale` is the part of `intensity` holding the current mask.
+// Writes an image in compute mode, readers need a barrier.
+void updateOutline(Outline &outline, const gl::texture_2d &intensity,
+                   glm::vec2 intensity_scale);
+
+// Copies the interesting and traces quadrants of textures.current() into
+// the red and green channels of `classes`, OUTLINE_CLASSES_SIZE texels per
+// side, so compose reads both with one fetch. getOutlineScale() is also
+// the part of `classes` holding the current state. Writes an image,
+// readers need a barrier.
+void packOutlineClasses(Outline &outline, const gl::texture_2d &classes);
+
+// Runs both outline implementations on the same input and returns the
+// largest absolute difference between their results.
+float validateOutline(Outline &outline, const gl::texture_2d &intensity,
+                      glm::vec2 intensity_scale);
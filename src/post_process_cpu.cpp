@@ -0,0 +1,876 @@
+#include "post_process_cpu.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WITCHER_SENSES_SSE2
+#endif
+
+namespace {
+
+// Rows handed to a worker at once. A band of 16 rows of the window is
+// about 20k pixels, enough to amortize claiming the chunk.
+constexpr std::size_t ROW_CHUNK_SIZE = 16;
+
+// 0.7 + 0.16 * pow(0.1, 100) in outline.frag, the power underflows to 0.
+constexpr float OUTLINE_DAMPING = 0.7f;
+
+void forEachRowBand(int height, ThreadPool *pool,
+                    const std::function<void(int, int)> &fn) {
+  if (!pool) {
+    fn(0, height);
+    return;
+  }
+  pool->parallelFor(std::size_t(height), ROW_CHUNK_SIZE,
+                    [&fn](std::size_t begin, std::size_t end) {
+                      fn(int(begin), int(end));
+                    });
+}
+
+int wrapRepeat(int i, int size) { return ((i % size) + size) % size; }
+
+glm::vec2 fract(glm::vec2 v) { return v - glm::floor(v); }
+
+float getParams(glm::vec2 uv) {
+  return std::max(1.0f - glm::dot(uv, uv), 0.0f);
+}
+
+// GLSL integer arithmetic wraps, so the products are done unsigned.
+float integerNoise(int32_t n) {
+  n = (n >> 13) ^ n;
+  const auto u = uint32_t(n);
+  const uint32_t nn = (u * (u * u * 60493u + 19990303u) + 1376312589u) &
+                      0x7fffffffu;
+  return float(int32_t(nn)) / 1073741824.0f;
+}
+
+int32_t bitfieldReverse(int32_t value) {
+  auto v = uint32_t(value);
+  uint32_t reversed = 0;
+  for (int i = 0; i < 32; ++i) {
+    reversed = (reversed << 1) | (v & 1u);
+    v >>= 1;
+  }
+  return int32_t(reversed);
+}
+
+glm::vec3 tonemap(glm::vec3 color) {
+  constexpr float exposure = 1.0f;
+  return glm::vec3(1.0f) - glm::exp(-color * exposure);
+}
+
+} // namespace
+
+FloatImage::FloatImage(int width, int height)
+    : width(width), height(height),
+      pixels(std::size_t(width) * std::size_t(height)) {}
+
+glm::vec4 &FloatImage::at(int x, int y) {
+  return pixels[std::size_t(y) * std::size_t(width) + std::size_t(x)];
+}
+
+const glm::vec4 &FloatImage::at(int x, int y) const {
+  return pixels[std::size_t(y) * std::size_t(width) + std::size_t(x)];
+}
+
+PlanarImage::PlanarImage(int width, int height)
+    : width(width), height(height) {
+  for (auto &plane : planes) {
+    plane.resize(std::size_t(width) * std::size_t(height));
+  }
+}
+
+float *PlanarImage::row(int channel, int y) {
+  return planes[channel].data() + std::size_t(y) * std::size_t(width);
+}
+
+const float *PlanarImage::row(int channel, int y) const {
+  return planes[channel].data() + std::size_t(y) * std::size_t(width);
+}
+
+PlanarImage toPlanarImage(const FloatImage &image) {
+  PlanarImage planar(image.width, image.height);
+  for (std::size_t i = 0; i < image.pixels.size(); ++i) {
+    for (int c = 0; c < 4; ++c) {
+      planar.planes[c][i] = image.pixels[i][c];
+    }
+  }
+  return planar;
+}
+
+FloatImage toFloatImage(const PlanarImage &image) {
+  FloatImage interleaved(image.width, image.height);
+  for (std::size_t i = 0; i < interleaved.pixels.size(); ++i) {
+    for (int c = 0; c < 4; ++c) {
+      interleaved.pixels[i][c] = image.planes[c][i];
+    }
+  }
+  return interleaved;
+}
+
+glm::vec4 sampleBilinear(const FloatImage &image, glm::vec2 uv) {
+  const glm::vec2 texel =
+      uv * glm::vec2(float(image.width), float(image.height)) - 0.5f;
+  const glm::vec2 floored = glm::floor(texel);
+  const glm::vec2 weight = texel - floored;
+  int x0 = int(floored.x);
+  int y0 = int(floored.y);
+  int x1 = x0 + 1;
+  int y1 = y0 + 1;
+  // Only samples within half a texel of an edge wrap.
+  if (unsigned(x0) >= unsigned(image.width - 1)) {
+    x0 = wrapRepeat(x0, image.width);
+    x1 = wrapRepeat(x1, image.width);
+  }
+  if (unsigned(y0) >= unsigned(image.height - 1)) {
+    y0 = wrapRepeat(y0, image.height);
+    y1 = wrapRepeat(y1, image.height);
+  }
+
+  const float wx0 = 1.0f - weight.x;
+  const float wy0 = 1.0f - weight.y;
+  return image.at(x0, y0) * (wx0 * wy0) + image.at(x1, y0) * (weight.x * wy0) +
+         image.at(x0, y1) * (wx0 * weight.y) +
+         image.at(x1, y1) * (weight.x * weight.y);
+}
+
+float getMaxDifference(const FloatImage &a, const FloatImage &b,
+                       int channels) {
+  const int width = std::min(a.width, b.width);
+  const int height = std::min(a.height, b.height);
+  float max_difference = 0.0f;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const glm::vec4 difference = glm::abs(a.at(x, y) - b.at(x, y));
+      for (int c = 0; c < channels; ++c) {
+        max_difference = std::max(max_difference, difference[c]);
+      }
+    }
+  }
+  return max_difference;
+}
+
+void updateOutlineCpu(const FloatImage &intensity, const FloatImage &history,
+                      const OutlineInputs &inputs, FloatImage &out,
+                      ThreadPool *pool) {
+  out = FloatImage(inputs.size, inputs.size);
+  const glm::vec2 outline_texel_size(1.0f / float(inputs.size));
+  const glm::vec2 history_scale(float(inputs.history_size) /
+                                float(history.width));
+  const auto sample_intensity = [&](glm::vec2 texture_uv) {
+    return sampleBilinear(intensity,
+                          fract(texture_uv) * inputs.intensity_scale);
+  };
+  const auto sample_history = [&](glm::vec2 uv) {
+    return glm::vec2(sampleBilinear(history, uv * history_scale));
+  };
+
+  forEachRowBand(inputs.size, pool, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < inputs.size; ++x) {
+        const glm::vec2 uv =
+            (glm::vec2(float(x), float(y)) + 0.5f) * outline_texel_size;
+
+        const glm::vec2 texture_uv = uv * 2.0f;
+        const glm::vec2 floored_uv = glm::floor(texture_uv);
+        const glm::vec4 mask(getParams(floored_uv),
+                             getParams(floored_uv + glm::vec2(-1.0f, 0.0f)),
+                             getParams(floored_uv + glm::vec2(0.0f, -1.0f)),
+                             getParams(floored_uv + glm::vec2(-1.0f, -1.0f)));
+
+        const float master_filter =
+            glm::dot(sample_intensity(texture_uv), mask);
+
+        const glm::vec2 texel_size = 2.0f * outline_texel_size;
+        const glm::vec2 intensity_diff_x =
+            glm::vec2(sample_intensity(texture_uv +
+                                       glm::vec2(texel_size.x, 0.0f))) -
+            glm::vec2(sample_intensity(texture_uv +
+                                       glm::vec2(-texel_size.x, 0.0f)));
+        const glm::vec2 intensity_diff_y =
+            glm::vec2(sample_intensity(texture_uv +
+                                       glm::vec2(0.0f, texel_size.y))) -
+            glm::vec2(sample_intensity(texture_uv +
+                                       glm::vec2(0.0f, -texel_size.y)));
+
+        const glm::vec2 max_abs_difference = glm::clamp(
+            glm::max(glm::abs(intensity_diff_x), glm::abs(intensity_diff_y)),
+            0.0f, 1.0f);
+
+        const glm::vec2 outlines = master_filter * max_abs_difference;
+        const glm::vec2 last_outlines = sample_history(uv);
+
+        float param_outline = master_filter * 0.15f + last_outlines.y;
+        param_outline += 0.35f * outlines.r;
+        param_outline += 0.35f * outlines.g;
+
+        const glm::vec2 noise_inputs =
+            150.0f * uv + 300.0f * glm::vec2(inputs.time, 0.0f);
+        const glm::ivec2 i_noise_inputs(noise_inputs);
+        const int32_t noise_seed = int32_t(
+            uint32_t(i_noise_inputs.x) +
+            uint32_t(bitfieldReverse(i_noise_inputs.y)));
+        const float noise0 =
+            std::clamp(integerNoise(noise_seed), -1.0f, 1.0f) + 0.65f;
+
+        const auto neighbour = [&](glm::vec2 offset) {
+          return sample_history(glm::clamp(uv + offset, 0.0f, 1.0f)).x;
+        };
+        const float average_outline =
+            (neighbour({outline_texel_size.x, 0.0f}) +
+             neighbour({-outline_texel_size.x, 0.0f}) +
+             neighbour({0.0f, outline_texel_size.y}) +
+             neighbour({0.0f, -outline_texel_size.y})) /
+            4.0f;
+
+        const float frame_outline_difference =
+            (average_outline - last_outlines.x) * noise0;
+        const float new_noise = last_outlines.x * noise0;
+
+        float new_outline = frame_outline_difference * 0.9f + param_outline;
+        new_outline -= 0.24f * new_noise;
+
+        const glm::vec2 final_outline(last_outlines.x + new_outline,
+                                      new_outline);
+        out.at(x, y) = glm::vec4(final_outline * OUTLINE_DAMPING, 0.0f, 1.0f);
+      }
+    }
+  });
+}
+
+void packOutlineClassesCpu(const FloatImage &outline, int size,
+                           FloatImage &out) {
+  out = FloatImage(outline.width / 2, outline.height / 2);
+  const int half_size = size / 2;
+  for (int y = 0; y < half_size; ++y) {
+    for (int x = 0; x < half_size; ++x) {
+      out.at(x, y) = glm::vec4(outline.at(x, y).x,
+                               outline.at(x + half_size, y).x, 0.0f, 1.0f);
+    }
+  }
+}
+
+void composeCpu(const FloatImage &color, const FloatImage &outline,
+                const FloatImage &intensity, const ComposeInputs &inputs,
+                FloatImage &out, ThreadPool *pool) {
+  out = FloatImage(color.width, color.height);
+  const glm::vec3 color_interesting(1.0f, 0.8f, 0.4f);
+  const glm::vec3 color_traces(1.0f, 0.0f, 0.0f);
+  const float zoom_amount = inputs.zoom_amount;
+  const float fisheye_amount = std::clamp(zoom_amount, 0.0f, 1.0f);
+  const float aspect_ratio = float(color.width) / float(color.height);
+  const auto sample_outline = [&](glm::vec2 uv) {
+    return glm::vec2(sampleBilinear(outline, uv * inputs.outline_scale));
+  };
+
+  forEachRowBand(color.height, pool, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < color.width; ++x) {
+        const glm::vec2 uv(
+            (float(x) + 0.5f) / float(color.width),
+            (float(y) + 0.5f) / float(color.height));
+        const glm::vec2 uv3 = glm::abs(uv * 2.0f - 1.0f);
+
+        glm::vec2 corner_uv = glm::vec2(uv3.x * aspect_ratio, uv3.y);
+        corner_uv = glm::pow(glm::clamp(corner_uv / 1.8f, 0.0f, 1.0f),
+                             glm::vec2(2.5f));
+        const float mask_gray_corners =
+            1.0f - std::min(1.0f, glm::length(corner_uv));
+
+        const glm::vec2 corners0 =
+            glm::clamp(glm::vec2(0.03f) - uv, 0.0f, 1.0f);
+        const glm::vec2 corners1 =
+            glm::clamp(uv - glm::vec2(0.97f), 0.0f, 1.0f);
+        float circle_radius = std::clamp(
+            (corners0.x + corners0.y + corners1.x + corners1.y) * 20.0f, 0.0f,
+            1.0f);
+
+        glm::vec2 uv4 = 2.0f * uv - 1.0f;
+        uv4 *= glm::dot(uv4, uv4);
+        uv4 *= fisheye_amount * 0.1f;
+        const glm::vec2 offset_uv =
+            glm::clamp(uv4, -0.4f, 0.4f) * zoom_amount;
+        const glm::vec2 color_uv = uv - offset_uv;
+
+        const glm::vec3 scene(sampleBilinear(color, color_uv));
+
+        glm::vec2 outlines = sample_outline(color_uv) / 8.0f;
+
+        circle_radius = (1.0f - circle_radius) * 0.03f;
+
+        glm::vec2 outlines_circle(0.0f);
+        glm::vec3 color_circle_main(0.0f);
+        for (const glm::vec2 direction : inputs.circle_directions) {
+          const glm::vec2 unit_circle = direction * circle_radius;
+          outlines_circle += sample_outline(color_uv + unit_circle / 8.0f);
+          color_circle_main += glm::vec3(
+              sampleBilinear(color, color_uv + unit_circle * offset_uv));
+        }
+        outlines += outlines_circle / 8.0f;
+        color_circle_main /= 8.0f;
+        const float outline_interesting = outlines.x;
+        const float outline_traces = outlines.y;
+
+        const glm::vec2 senses_intensity(
+            sampleBilinear(intensity, color_uv * inputs.intensity_scale));
+        const float main_outline_interesting = std::clamp(
+            outline_interesting - 0.8f * senses_intensity.r, 0.0f, 1.0f);
+        const float main_outline_traces = std::clamp(
+            outline_traces - 0.75f * senses_intensity.g, 0.0f, 1.0f);
+
+        const glm::vec3 color_greyish(
+            glm::dot(color_circle_main, glm::vec3(0.3f)));
+        glm::vec3 main_color =
+            glm::mix(color_greyish, color_circle_main, mask_gray_corners) *
+            0.7f;
+        main_color = glm::mix(scene, main_color, fisheye_amount);
+
+        const glm::vec3 senses_total =
+            1.2f * (main_outline_traces * color_traces) +
+            main_outline_interesting * color_interesting;
+        const glm::vec3 senses_total_sat =
+            glm::clamp(1.2f * senses_total, 0.0f, 1.0f);
+        const float dot_senses_total =
+            std::clamp(glm::dot(senses_total, glm::vec3(1.0f)), 0.0f, 1.0f) *
+            zoom_amount;
+
+        glm::vec3 final_color =
+            glm::mix(main_color, senses_total_sat, dot_senses_total);
+        if (inputs.tonemap) {
+          final_color = tonemap(final_color);
+        }
+        out.at(x, y) = glm::vec4(final_color, 1.0f);
+      }
+    }
+  });
+}
+
+void tonemapCpu(const FloatImage &hdr, FloatImage &out, ThreadPool *pool) {
+  out = FloatImage(hdr.width, hdr.height);
+  forEachRowBand(hdr.height, pool, [&](int begin, int end) {
+    // Texel centers sample a single texel, so this is a straight map.
+    const std::size_t first = std::size_t(begin) * std::size_t(hdr.width);
+    const std::size_t last = std::size_t(end) * std::size_t(hdr.width);
+    for (std::size_t i = first; i < last; ++i) {
+      out.pixels[i] = glm::vec4(tonemap(glm::vec3(hdr.pixels[i])), 1.0f);
+    }
+  });
+}
+
+#ifdef WITCHER_SENSES_SSE2
+
+namespace {
+
+constexpr int LANES = 4;
+
+struct Vec2x4 {
+  __m128 x;
+  __m128 y;
+};
+
+__m128 set1(float value) { return _mm_set1_ps(value); }
+
+__m128 clamp4(__m128 v, float lo, float hi) {
+  return _mm_min_ps(_mm_max_ps(v, set1(lo)), set1(hi));
+}
+
+__m128 abs4(__m128 v) { return _mm_andnot_ps(set1(-0.0f), v); }
+
+// Exact for |v| < 2^31, which every texel coordinate is.
+__m128 floor4(__m128 v) {
+  const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+  return _mm_sub_ps(truncated,
+                    _mm_and_ps(_mm_cmpgt_ps(truncated, v), set1(1.0f)));
+}
+
+// e^x with the Cephes polynomial, within 2 ulps over the float range.
+__m128 exp4(__m128 x) {
+  x = clamp4(x, -88.3762626647949f, 88.3762626647949f);
+  const __m128 n = floor4(
+      _mm_add_ps(_mm_mul_ps(x, set1(1.44269504088896341f)), set1(0.5f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, set1(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, set1(-2.12194440e-4f)));
+
+  __m128 y = set1(1.9875691500e-4f);
+  for (const float coefficient :
+       {1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f,
+        1.6666665459e-1f, 5.0000001201e-1f}) {
+    y = _mm_add_ps(_mm_mul_ps(y, x), set1(coefficient));
+  }
+  y = _mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x);
+  y = _mm_add_ps(y, set1(1.0f));
+
+  const __m128i exponent = _mm_slli_epi32(
+      _mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(exponent));
+}
+
+__m128 tonemap4(__m128 color) {
+  return _mm_sub_ps(set1(1.0f), exp4(_mm_sub_ps(_mm_setzero_ps(), color)));
+}
+
+// a * b of each 32-bit lane, wrapping like GLSL. SSE2 only multiplies the
+// even lanes, so the odd ones are shifted down and multiplied apart.
+__m128i mullo4(__m128i a, __m128i b) {
+  const __m128i even = _mm_mul_epu32(a, b);
+  const __m128i odd =
+      _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__m128 integerNoise4(__m128i n) {
+  n = _mm_xor_si128(_mm_srai_epi32(n, 13), n);
+  __m128i nn = _mm_add_epi32(mullo4(n, mullo4(n, _mm_set1_epi32(60493))),
+                             _mm_set1_epi32(19990303));
+  nn = _mm_add_epi32(mullo4(n, nn), _mm_set1_epi32(1376312589));
+  nn = _mm_and_si128(nn, _mm_set1_epi32(0x7fffffff));
+  return _mm_mul_ps(_mm_cvtepi32_ps(nn), set1(1.0f / 1073741824.0f));
+}
+
+__m128i bitfieldReverse4(__m128i v) {
+  const auto swap = [](__m128i value, int shift, int32_t mask) {
+    const __m128i m = _mm_set1_epi32(mask);
+    return _mm_or_si128(
+        _mm_and_si128(_mm_srli_epi32(value, shift), m),
+        _mm_slli_epi32(_mm_and_si128(value, m), shift));
+  };
+  v = swap(v, 1, 0x55555555);
+  v = swap(v, 2, 0x33333333);
+  v = swap(v, 4, 0x0f0f0f0f);
+  v = swap(v, 8, 0x00ff00ff);
+  return _mm_or_si128(_mm_srli_epi32(v, 16), _mm_slli_epi32(v, 16));
+}
+
+// sampleBilinear() at four uvs for the first `channels` planes. The weights
+// are computed on vectors, the taps are gathered lane by lane.
+void sampleBilinear4(const PlanarImage &image, Vec2x4 uv, int channels,
+                     __m128 *out) {
+  const __m128 texel_x =
+      _mm_sub_ps(_mm_mul_ps(uv.x, set1(float(image.width))), set1(0.5f));
+  const __m128 texel_y =
+      _mm_sub_ps(_mm_mul_ps(uv.y, set1(float(image.height))), set1(0.5f));
+  const __m128 floored_x = floor4(texel_x);
+  const __m128 floored_y = floor4(texel_y);
+  const __m128 weight_x = _mm_sub_ps(texel_x, floored_x);
+  const __m128 weight_y = _mm_sub_ps(texel_y, floored_y);
+
+  alignas(16) int32_t x0[LANES];
+  alignas(16) int32_t y0[LANES];
+  _mm_store_si128(reinterpret_cast<__m128i *>(x0),
+                  _mm_cvttps_epi32(floored_x));
+  _mm_store_si128(reinterpret_cast<__m128i *>(y0),
+                  _mm_cvttps_epi32(floored_y));
+  std::size_t taps[4][LANES];
+  for (int lane = 0; lane < LANES; ++lane) {
+    int x1 = x0[lane] + 1;
+    int y1 = y0[lane] + 1;
+    if (unsigned(x0[lane]) >= unsigned(image.width - 1)) {
+      x0[lane] = wrapRepeat(x0[lane], image.width);
+      x1 = wrapRepeat(x1, image.width);
+    }
+    if (unsigned(y0[lane]) >= unsigned(image.height - 1)) {
+      y0[lane] = wrapRepeat(y0[lane], image.height);
+      y1 = wrapRepeat(y1, image.height);
+    }
+    const std::size_t row0 = std::size_t(y0[lane]) * std::size_t(image.width);
+    const std::size_t row1 = std::size_t(y1) * std::size_t(image.width);
+    taps[0][lane] = row0 + std::size_t(x0[lane]);
+    taps[1][lane] = row0 + std::size_t(x1);
+    taps[2][lane] = row1 + std::size_t(x0[lane]);
+    taps[3][lane] = row1 + std::size_t(x1);
+  }
+
+  const __m128 wx0 = _mm_sub_ps(set1(1.0f), weight_x);
+  const __m128 wy0 = _mm_sub_ps(set1(1.0f), weight_y);
+  const __m128 weights[4] = {
+      _mm_mul_ps(wx0, wy0), _mm_mul_ps(weight_x, wy0),
+      _mm_mul_ps(wx0, weight_y), _mm_mul_ps(weight_x, weight_y)};
+  for (int c = 0; c < channels; ++c) {
+    const float *plane = image.planes[c].data();
+    __m128 sum = _mm_setzero_ps();
+    for (int tap = 0; tap < 4; ++tap) {
+      const __m128 values =
+          _mm_setr_ps(plane[taps[tap][0]], plane[taps[tap][1]],
+                      plane[taps[tap][2]], plane[taps[tap][3]]);
+      sum = _mm_add_ps(sum, _mm_mul_ps(values, weights[tap]));
+    }
+    out[c] = sum;
+  }
+}
+
+// uvs of the texel centers x to x + 3 of row y.
+Vec2x4 getTexelUvs(int x, int y, glm::vec2 texel_size) {
+  const __m128 xs = _mm_add_ps(_mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2,
+                                                              x + 3)),
+                               set1(0.5f));
+  return {_mm_mul_ps(xs, set1(texel_size.x)),
+          set1((float(y) + 0.5f) * texel_size.y)};
+}
+
+// Stores the first `count` lanes of each channel at pixel x of row y. The
+// lanes past the end of a row are computed like the others, from wrapped
+// or clamped samples, and dropped here.
+void storePixels(PlanarImage &out, int x, int y, const __m128 *channels,
+                 int count) {
+  for (int c = 0; c < 4; ++c) {
+    float *row = out.row(c, y) + x;
+    if (count == LANES) {
+      _mm_storeu_ps(row, channels[c]);
+    } else {
+      alignas(16) float lanes[LANES];
+      _mm_store_ps(lanes, channels[c]);
+      std::copy(lanes, lanes + count, row);
+    }
+  }
+}
+
+} // namespace
+
+void updateOutlineSimd(const PlanarImage &intensity,
+                       const PlanarImage &history, const OutlineInputs &inputs,
+                       PlanarImage &out, ThreadPool *pool) {
+  out = PlanarImage(inputs.size, inputs.size);
+  const glm::vec2 outline_texel_size(1.0f / float(inputs.size));
+  const float history_scale =
+      float(inputs.history_size) / float(history.width);
+  const __m128 one = set1(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+
+  // Takes fract(texture_uv) like the scalar version.
+  const auto sample_intensity = [&](__m128 u, __m128 v, int channels,
+                                    __m128 *result) {
+    sampleBilinear4(intensity,
+                    {_mm_mul_ps(_mm_sub_ps(u, floor4(u)),
+                                set1(inputs.intensity_scale.x)),
+                     _mm_mul_ps(_mm_sub_ps(v, floor4(v)),
+                                set1(inputs.intensity_scale.y))},
+                    channels, result);
+  };
+  const auto sample_history = [&](__m128 u, __m128 v, int channels,
+                                  __m128 *result) {
+    sampleBilinear4(history,
+                    {_mm_mul_ps(u, set1(history_scale)),
+                     _mm_mul_ps(v, set1(history_scale))},
+                    channels, result);
+  };
+  const auto get_params = [&](__m128 u, __m128 v) {
+    const __m128 length2 = _mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v));
+    return _mm_max_ps(_mm_sub_ps(one, length2), zero);
+  };
+
+  forEachRowBand(inputs.size, pool, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < inputs.size; x += LANES) {
+        const Vec2x4 uv = getTexelUvs(x, y, outline_texel_size);
+
+        const __m128 texture_u = _mm_mul_ps(uv.x, set1(2.0f));
+        const __m128 texture_v = _mm_mul_ps(uv.y, set1(2.0f));
+        const __m128 floored_u = floor4(texture_u);
+        const __m128 floored_v = floor4(texture_v);
+        const __m128 shifted_u = _mm_sub_ps(floored_u, one);
+        const __m128 shifted_v = _mm_sub_ps(floored_v, one);
+        const __m128 mask[4] = {get_params(floored_u, floored_v),
+                                get_params(shifted_u, floored_v),
+                                get_params(floored_u, shifted_v),
+                                get_params(shifted_u, shifted_v)};
+
+        __m128 center[4];
+        sample_intensity(texture_u, texture_v, 4, center);
+        __m128 master_filter = _mm_mul_ps(center[0], mask[0]);
+        for (int c = 1; c < 4; ++c) {
+          master_filter =
+              _mm_add_ps(master_filter, _mm_mul_ps(center[c], mask[c]));
+        }
+
+        const __m128 texel_size_u = set1(2.0f * outline_texel_size.x);
+        const __m128 texel_size_v = set1(2.0f * outline_texel_size.y);
+        __m128 right[2];
+        __m128 left[2];
+        __m128 up[2];
+        __m128 down[2];
+        sample_intensity(_mm_add_ps(texture_u, texel_size_u), texture_v, 2,
+                         right);
+        sample_intensity(_mm_sub_ps(texture_u, texel_size_u), texture_v, 2,
+                         left);
+        sample_intensity(texture_u, _mm_add_ps(texture_v, texel_size_v), 2,
+                         up);
+        sample_intensity(texture_u, _mm_sub_ps(texture_v, texel_size_v), 2,
+                         down);
+        __m128 outlines[2];
+        for (int c = 0; c < 2; ++c) {
+          const __m128 max_abs_difference =
+              clamp4(_mm_max_ps(abs4(_mm_sub_ps(right[c], left[c])),
+                                abs4(_mm_sub_ps(up[c], down[c]))),
+                     0.0f, 1.0f);
+          outlines[c] = _mm_mul_ps(master_filter, max_abs_difference);
+        }
+
+        __m128 last_outlines[2];
+        sample_history(uv.x, uv.y, 2, last_outlines);
+
+        __m128 param_outline = _mm_add_ps(
+            _mm_mul_ps(master_filter, set1(0.15f)), last_outlines[1]);
+        param_outline =
+            _mm_add_ps(param_outline, _mm_mul_ps(set1(0.35f), outlines[0]));
+        param_outline =
+            _mm_add_ps(param_outline, _mm_mul_ps(set1(0.35f), outlines[1]));
+
+        const __m128 noise_u = _mm_add_ps(_mm_mul_ps(set1(150.0f), uv.x),
+                                          set1(300.0f * inputs.time));
+        const __m128 noise_v = _mm_mul_ps(set1(150.0f), uv.y);
+        const __m128i noise_seed =
+            _mm_add_epi32(_mm_cvttps_epi32(noise_u),
+                          bitfieldReverse4(_mm_cvttps_epi32(noise_v)));
+        const __m128 noise0 = _mm_add_ps(
+            clamp4(integerNoise4(noise_seed), -1.0f, 1.0f), set1(0.65f));
+
+        const auto neighbour = [&](float offset_u, float offset_v) {
+          __m128 value;
+          sample_history(clamp4(_mm_add_ps(uv.x, set1(offset_u)), 0.0f, 1.0f),
+                         clamp4(_mm_add_ps(uv.y, set1(offset_v)), 0.0f, 1.0f),
+                         1, &value);
+          return value;
+        };
+        __m128 average_outline = neighbour(outline_texel_size.x, 0.0f);
+        average_outline = _mm_add_ps(average_outline,
+                                     neighbour(-outline_texel_size.x, 0.0f));
+        average_outline = _mm_add_ps(average_outline,
+                                     neighbour(0.0f, outline_texel_size.y));
+        average_outline = _mm_add_ps(average_outline,
+                                     neighbour(0.0f, -outline_texel_size.y));
+        average_outline = _mm_div_ps(average_outline, set1(4.0f));
+
+        const __m128 frame_outline_difference = _mm_mul_ps(
+            _mm_sub_ps(average_outline, last_outlines[0]), noise0);
+        const __m128 new_noise = _mm_mul_ps(last_outlines[0], noise0);
+
+        __m128 new_outline = _mm_add_ps(
+            _mm_mul_ps(frame_outline_difference, set1(0.9f)), param_outline);
+        new_outline =
+            _mm_sub_ps(new_outline, _mm_mul_ps(set1(0.24f), new_noise));
+
+        const __m128 result[4] = {
+            _mm_mul_ps(_mm_add_ps(last_outlines[0], new_outline),
+                       set1(OUTLINE_DAMPING)),
+            _mm_mul_ps(new_outline, set1(OUTLINE_DAMPING)), zero, one};
+        storePixels(out, x, y, result, std::min(LANES, inputs.size - x));
+      }
+    }
+  });
+}
+
+void composeSimd(const PlanarImage &color, const PlanarImage &outline,
+                 const PlanarImage &intensity, const ComposeInputs &inputs,
+                 PlanarImage &out, ThreadPool *pool) {
+  out = PlanarImage(color.width, color.height);
+  const glm::vec2 texel_size(1.0f / float(color.width),
+                             1.0f / float(color.height));
+  const float zoom_amount = inputs.zoom_amount;
+  const float fisheye_amount = std::clamp(zoom_amount, 0.0f, 1.0f);
+  const float aspect_ratio = float(color.width) / float(color.height);
+  const __m128 one = set1(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+
+  const auto sample_outline = [&](__m128 u, __m128 v, __m128 *out) {
+    sampleBilinear4(outline,
+                    {_mm_mul_ps(u, set1(inputs.outline_scale.x)),
+                     _mm_mul_ps(v, set1(inputs.outline_scale.y))},
+                    2, out);
+  };
+  const auto mix4 = [](__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+  };
+
+  forEachRowBand(color.height, pool, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < color.width; x += LANES) {
+        const Vec2x4 uv = getTexelUvs(x, y, texel_size);
+        const __m128 uv3_x = abs4(_mm_sub_ps(_mm_add_ps(uv.x, uv.x), one));
+        const __m128 uv3_y = abs4(_mm_sub_ps(_mm_add_ps(uv.y, uv.y), one));
+
+        // pow(c, 2.5) as c * c * sqrt(c)
+        const auto pow_2_5 = [](__m128 c) {
+          return _mm_mul_ps(_mm_mul_ps(c, c), _mm_sqrt_ps(c));
+        };
+        const __m128 corner_x = pow_2_5(clamp4(
+            _mm_div_ps(_mm_mul_ps(uv3_x, set1(aspect_ratio)), set1(1.8f)),
+            0.0f, 1.0f));
+        const __m128 corner_y =
+            pow_2_5(clamp4(_mm_div_ps(uv3_y, set1(1.8f)), 0.0f, 1.0f));
+        const __m128 mask_gray_corners = _mm_sub_ps(
+            one, _mm_min_ps(one, _mm_sqrt_ps(_mm_add_ps(
+                                     _mm_mul_ps(corner_x, corner_x),
+                                     _mm_mul_ps(corner_y, corner_y)))));
+
+        const __m128 corners = _mm_add_ps(
+            _mm_add_ps(clamp4(_mm_sub_ps(set1(0.03f), uv.x), 0.0f, 1.0f),
+                       clamp4(_mm_sub_ps(set1(0.03f), uv.y), 0.0f, 1.0f)),
+            _mm_add_ps(clamp4(_mm_sub_ps(uv.x, set1(0.97f)), 0.0f, 1.0f),
+                       clamp4(_mm_sub_ps(uv.y, set1(0.97f)), 0.0f, 1.0f)));
+        __m128 circle_radius =
+            clamp4(_mm_mul_ps(corners, set1(20.0f)), 0.0f, 1.0f);
+
+        __m128 uv4_x = _mm_sub_ps(_mm_mul_ps(set1(2.0f), uv.x), one);
+        __m128 uv4_y = _mm_sub_ps(_mm_mul_ps(set1(2.0f), uv.y), one);
+        const __m128 length2 =
+            _mm_add_ps(_mm_mul_ps(uv4_x, uv4_x), _mm_mul_ps(uv4_y, uv4_y));
+        const __m128 fisheye = set1(fisheye_amount * 0.1f);
+        uv4_x = _mm_mul_ps(_mm_mul_ps(uv4_x, length2), fisheye);
+        uv4_y = _mm_mul_ps(_mm_mul_ps(uv4_y, length2), fisheye);
+        const __m128 offset_x =
+            _mm_mul_ps(clamp4(uv4_x, -0.4f, 0.4f), set1(zoom_amount));
+        const __m128 offset_y =
+            _mm_mul_ps(clamp4(uv4_y, -0.4f, 0.4f), set1(zoom_amount));
+        const Vec2x4 color_uv{_mm_sub_ps(uv.x, offset_x),
+                              _mm_sub_ps(uv.y, offset_y)};
+
+        __m128 scene[3];
+        sampleBilinear4(color, color_uv, 3, scene);
+
+        __m128 outlines[2];
+        sample_outline(color_uv.x, color_uv.y, outlines);
+
+        circle_radius =
+            _mm_mul_ps(_mm_sub_ps(one, circle_radius), set1(0.03f));
+
+        __m128 outlines_circle[2] = {zero, zero};
+        __m128 color_circle_main[3] = {zero, zero, zero};
+        for (const glm::vec2 direction : inputs.circle_directions) {
+          const __m128 unit_x = _mm_mul_ps(set1(direction.x), circle_radius);
+          const __m128 unit_y = _mm_mul_ps(set1(direction.y), circle_radius);
+          __m128 outline_tap[2];
+          sample_outline(
+              _mm_add_ps(color_uv.x, _mm_div_ps(unit_x, set1(8.0f))),
+              _mm_add_ps(color_uv.y, _mm_div_ps(unit_y, set1(8.0f))),
+              outline_tap);
+          for (int c = 0; c < 2; ++c) {
+            outlines_circle[c] = _mm_add_ps(outlines_circle[c], outline_tap[c]);
+          }
+          __m128 tap[3];
+          sampleBilinear4(
+              color,
+              {_mm_add_ps(color_uv.x, _mm_mul_ps(unit_x, offset_x)),
+               _mm_add_ps(color_uv.y, _mm_mul_ps(unit_y, offset_y))},
+              3, tap);
+          for (int c = 0; c < 3; ++c) {
+            color_circle_main[c] = _mm_add_ps(color_circle_main[c], tap[c]);
+          }
+        }
+        for (int c = 0; c < 2; ++c) {
+          outlines[c] = _mm_add_ps(_mm_div_ps(outlines[c], set1(8.0f)),
+                                   _mm_div_ps(outlines_circle[c], set1(8.0f)));
+        }
+        const __m128 outline_interesting = outlines[0];
+        const __m128 outline_traces = outlines[1];
+        for (auto &channel : color_circle_main) {
+          channel = _mm_div_ps(channel, set1(8.0f));
+        }
+
+        __m128 senses_intensity[2];
+        sampleBilinear4(intensity,
+                        {_mm_mul_ps(color_uv.x,
+                                    set1(inputs.intensity_scale.x)),
+                         _mm_mul_ps(color_uv.y,
+                                    set1(inputs.intensity_scale.y))},
+                        2, senses_intensity);
+        const __m128 main_outline_interesting =
+            clamp4(_mm_sub_ps(outline_interesting,
+                              _mm_mul_ps(set1(0.8f), senses_intensity[0])),
+                   0.0f, 1.0f);
+        const __m128 main_outline_traces =
+            clamp4(_mm_sub_ps(outline_traces,
+                              _mm_mul_ps(set1(0.75f), senses_intensity[1])),
+                   0.0f, 1.0f);
+
+        const __m128 color_greyish = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(color_circle_main[0], set1(0.3f)),
+                       _mm_mul_ps(color_circle_main[1], set1(0.3f))),
+            _mm_mul_ps(color_circle_main[2], set1(0.3f)));
+
+        // color_traces is (1, 0, 0) and color_interesting (1, 0.8, 0.4).
+        const __m128 traces = _mm_mul_ps(set1(1.2f), main_outline_traces);
+        const __m128 senses_total[3] = {
+            _mm_add_ps(traces, main_outline_interesting),
+            _mm_mul_ps(main_outline_interesting, set1(0.8f)),
+            _mm_mul_ps(main_outline_interesting, set1(0.4f))};
+        const __m128 dot_senses_total = _mm_mul_ps(
+            clamp4(_mm_add_ps(_mm_add_ps(senses_total[0], senses_total[1]),
+                              senses_total[2]),
+                   0.0f, 1.0f),
+            set1(zoom_amount));
+
+        __m128 result[4];
+        for (int c = 0; c < 3; ++c) {
+          __m128 main_color = _mm_mul_ps(
+              mix4(color_greyish, color_circle_main[c], mask_gray_corners),
+              set1(0.7f));
+          main_color = mix4(scene[c], main_color, set1(fisheye_amount));
+          const __m128 senses_total_sat =
+              clamp4(_mm_mul_ps(set1(1.2f), senses_total[c]), 0.0f, 1.0f);
+          result[c] = mix4(main_color, senses_total_sat, dot_senses_total);
+          if (inputs.tonemap) {
+            result[c] = tonemap4(result[c]);
+          }
+        }
+        result[3] = one;
+        storePixels(out, x, y, result, std::min(LANES, color.width - x));
+      }
+    }
+  });
+}
+
+void tonemapSimd(const PlanarImage &hdr, PlanarImage &out, ThreadPool *pool) {
+  out = PlanarImage(hdr.width, hdr.height);
+  forEachRowBand(hdr.height, pool, [&](int begin, int end) {
+    const std::size_t first = std::size_t(begin) * std::size_t(hdr.width);
+    const std::size_t last = std::size_t(end) * std::size_t(hdr.width);
+    std::size_t i = first;
+    for (; i + LANES <= last; i += LANES) {
+      for (int c = 0; c < 3; ++c) {
+        _mm_storeu_ps(out.planes[c].data() + i,
+                      tonemap4(_mm_loadu_ps(hdr.planes[c].data() + i)));
+      }
+      _mm_storeu_ps(out.planes[3].data() + i, set1(1.0f));
+    }
+    for (; i < last; ++i) {
+      const glm::vec3 color = tonemap(glm::vec3(
+          hdr.planes[0][i], hdr.planes[1][i], hdr.planes[2][i]));
+      for (int c = 0; c < 3; ++c) {
+        out.planes[c][i] = color[c];
+      }
+      out.planes[3][i] = 1.0f;
+    }
+  });
+}
+
+#else
+
+void updateOutlineSimd(const PlanarImage &intensity,
+                       const PlanarImage &history, const OutlineInputs &inputs,
+                       PlanarImage &out, ThreadPool *pool) {
+  FloatImage result;
+  updateOutlineCpu(toFloatImage(intensity), toFloatImage(history), inputs,
+                   result, pool);
+  out = toPlanarImage(result);
+}
+
+void composeSimd(const PlanarImage &color, const PlanarImage &outline,
+                 const PlanarImage &intensity, const ComposeInputs &inputs,
+                 PlanarImage &out, ThreadPool *pool) {
+  FloatImage result;
+  composeCpu(toFloatImage(color), toFloatImage(outline),
+             toFloatImage(intensity), inputs, result, pool);
+  out = toPlanarImage(result);
+}
+
+void tonemapSimd(const PlanarImage &hdr, PlanarImage &out, ThreadPool *pool) {
+  FloatImage result;
+  tonemapCpu(toFloatImage(hdr), result, pool);
+  out = toPlanarImage(result);
+}
+
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+
+// CPU versions of outline.frag, compose.frag and colormapping.frag. They
+// follow the shaders operation by operation so they can serve as a
+// regression oracle for the GPU passes and produce frames on machines
+// without a GPU. Nothing here touches GL. Each kernel comes in a scalar
+// version over FloatImage, which follows the shader most closely, and an
+// SSE version over PlanarImage, which shades four pixels per iteration.
+// Both spread bands of rows over the pool when one is given.
+
+// RGBA float image, rows from the bottom up like GL textures. Textures with
+// fewer channels read back as RGBA with blue 0 and alpha 1, which is also
+// what the shaders see when they sample them.
+struct FloatImage {
+  int width{0};
+  int height{0};
+  std::vector<glm::vec4> pixels{};
+
+  FloatImage() = default;
+  FloatImage(int width, int height);
+
+  glm::vec4 &at(int x, int y);
+  const glm::vec4 &at(int x, int y) const;
+};
+
+// One plane per channel, rows from the bottom up like FloatImage, so four
+// neighbouring pixels of a channel load as one vector.
+struct PlanarImage {
+  int width{0};
+  int height{0};
+  std::array<std::vector<float>, 4> planes{};
+
+  PlanarImage() = default;
+  PlanarImage(int width, int height);
+
+  float *row(int channel, int y);
+  const float *row(int channel, int y) const;
+};
+
+PlanarImage toPlanarImage(const FloatImage &image);
+FloatImage toFloatImage(const PlanarImage &image);
+
+// texture() with GL_LINEAR filtering and GL_REPEAT wrapping.
+glm::vec4 sampleBilinear(const FloatImage &image, glm::vec2 uv);
+
+// Largest absolute difference over the first `channels` channels of the
+// pixels both images cover.
+float getMaxDifference(const FloatImage &a, const FloatImage &b,
+                       int channels = 4);
+
+struct OutlineInputs {
+  // Texels per side of the active outline region
+  int size;
+  // Texels per side of the active region of the history
+  int history_size;
+  glm::vec2 intensity_scale;
+  float time;
+};
+
+struct ComposeInputs {
+  float zoom_amount;
+  glm::vec2 outline_scale;
+  glm::vec2 intensity_scale;
+  // See computeCircleDirections()
+  std::array<glm::vec2, 8> circle_directions;
+  // Applies the tonemap curve like compose.frag with FUSED_TONEMAP
+  bool tonemap;
+};
+
+// Runs outline.frag for the inputs.size texels in each direction, reading
+// the previous state from `history`, which holds the whole outline texture.
+// The history is read in place, as outline.frag does without reprojection
+// or when the camera did not move.
+// `out` is resized to inputs.size. Bands of rows are spread over the pool
+// when one is given.
+void updateOutlineCpu(const FloatImage &intensity, const FloatImage &history,
+                      const OutlineInputs &inputs, FloatImage &out,
+                      ThreadPool *pool = nullptr);
+
+// Runs outline_pack.comp: the interesting and traces quadrants of the
+// `size` texels of `outline` go to red and green of a texture half as wide
+// and high. Texels outside the active region are not written, like on
+// the GPU.
+void packOutlineClassesCpu(const FloatImage &outline, int size,
+                           FloatImage &out);
+
+// Runs compose.frag at the size of `color`, reading the outline as
+// packOutlineClassesCpu() writes it.
+void composeCpu(const FloatImage &color, const FloatImage &outline,
+                const FloatImage &intensity, const ComposeInputs &inputs,
+                FloatImage &out, ThreadPool *pool = nullptr);
+
+// Runs colormapping.frag at the size of `hdr`.
+void tonemapCpu(const FloatImage &hdr, FloatImage &out,
+                ThreadPool *pool = nullptr);
+
+// Largest difference between the SSE and the scalar kernels. exp() is a
+// polynomial and pow(x, 2.5) is x * x * sqrt(x) in the SSE versions.
+constexpr float SIMD_TOLERANCE = 1.0e-4f;
+
+// SSE versions of the kernels above, four pixels per iteration. Samples
+// are gathered lane by lane, the math in between runs on whole vectors.
+// Without SSE2 they fall back to the scalar kernels.
+void updateOutlineSimd(const PlanarImage &intensity,
+                       const PlanarImage &history, const OutlineInputs &inputs,
+                       PlanarImage &out, ThreadPool *pool = nullptr);
+void composeSimd(const PlanarImage &color, const PlanarImage &outline,
+                 const PlanarImage &intensity, const ComposeInputs &inputs,
+                 PlanarImage &out, ThreadPool *pool = nullptr);
+void tonemapSimd(const PlanarImage &hdr, PlanarImage &out,
+                 ThreadPool *pool = nullptr);
@@ -0,0 +1,251 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <utility>
+
+namespace {
+
+double toMs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void writeString(std::ostream &out, const std::string &value) {
+  out << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out << '\\';
+    }
+    out << c;
+  }
+  out << '"';
+}
+
+double getMedian(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  return samples[(samples.size() - 1) / 2];
+}
+
+void writeStats(std::ostream &out, std::vector<double> samples) {
+  if (samples.empty()) {
+    out << "null";
+    return;
+  }
+  double sum = 0.0;
+  for (double sample : samples) {
+    sum += sample;
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto percentile = [&](double p) {
+    return samples[std::size_t(p * double(samples.size() - 1))];
+  };
+  out << "{\"mean\": " << sum / double(samples.size())
+      << ", \"min\": " << samples.front()
+      << ", \"median\": " << percentile(0.5)
+      << ", \"p95\": " << percentile(0.95)
+      << ", \"max\": " << samples.back() << '}';
+}
+
+} // namespace
+
+Profiler::Profiler(uint32_t latency) : frames_(std::max(latency, 1u)) {}
+
+Profiler::~Profiler() {
+  for (auto &frame : frames_) {
+    if (!frame.pool.empty()) {
+      glDeleteQueries(GLsizei(frame.pool.size()), frame.pool.data());
+    }
+  }
+}
+
+void Profiler::beginFrame() {
+  auto &frame = frames_[frame_index_ % frames_.size()];
+  if (frame.pending) {
+    resolve(frame);
+  }
+  frame.passes.clear();
+  frame_start_ = Clock::now();
+}
+
+void Profiler::endFrame() {
+  frames_[frame_index_ % frames_.size()].pending = true;
+  frame_cpu_.samples.push_back(toMs(Clock::now() - frame_start_));
+  ++frame_index_;
+}
+
+void Profiler::beginPass(const char *name) {
+  auto &frame = frames_[frame_index_ % frames_.size()];
+  const auto used = 2 * frame.passes.size();
+  if (frame.pool.size() < used + 2) {
+    frame.pool.resize(used + 2);
+    glGenQueries(2, frame.pool.data() + used);
+  }
+
+  open_pass_ = int32_t(frame.passes.size());
+  frame.passes.push_back(
+      {findPass(name), frame.pool[used], frame.pool[used + 1], 0.0});
+  glQueryCounter(frame.pool[used], GL_TIMESTAMP);
+  pass_start_ = Clock::now();
+}
+
+void Profiler::endPass() {
+  if (open_pass_ < 0) {
+    return;
+  }
+  auto &pass = frames_[frame_index_ % frames_.size()].passes[open_pass_];
+  pass.cpu_ms = toMs(Clock::now() - pass_start_);
+  glQueryCounter(pass.end, GL_TIMESTAMP);
+  open_pass_ = -1;
+}
+
+void Profiler::setCounter(const char *name, double value) {
+  std::lock_guard lock(mutex_);
+  findCounter(name).samples.push_back(value);
+}
+
+void Profiler::setSystemTime(const char *name, double ms) {
+  std::lock_guard lock(mutex_);
+  for (auto &system : systems_) {
+    if (system.name == name) {
+      system.samples.push_back(ms);
+      return;
+    }
+  }
+  systems_.push_back({name, {ms}});
+}
+
+void Profiler::setInfo(const char *key, const std::string &value) {
+  std::lock_guard lock(mutex_);
+  for (auto &[info_key, info_value] : info_) {
+    if (info_key == key) {
+      info_value = value;
+      return;
+    }
+  }
+  info_.emplace_back(key, value);
+}
+
+void Profiler::addComparison(const char *name, const char *baseline,
+                             std::vector<double> baseline_ms,
+                             const char *candidate,
+                             std::vector<double> candidate_ms) {
+  std::lock_guard lock(mutex_);
+  comparisons_.push_back({name,
+                          {baseline, std::move(baseline_ms)},
+                          {candidate, std::move(candidate_ms)}});
+}
+
+void Profiler::flush() {
+  for (auto &frame : frames_) {
+    if (frame.pending) {
+      resolve(frame);
+    }
+  }
+}
+
+uint64_t Profiler::getFrameCount() const { return frame_index_; }
+
+double Profiler::getLastGpuFrameMs() const { return last_gpu_frame_ms_; }
+
+void Profiler::writeJson(std::ostream &out) const {
+  std::lock_guard lock(mutex_);
+  out << std::fixed << std::setprecision(4);
+  out << "{\n  \"frames\": " << frame_index_ << ",\n  \"info\": {";
+  for (std::size_t i = 0; i < info_.size(); ++i) {
+    out << (i == 0 ? "\n    " : ",\n    ");
+    writeString(out, info_[i].first);
+    out << ": ";
+    writeString(out, info_[i].second);
+  }
+  out << "\n  },\n  \"frame_cpu_ms\": ";
+  writeStats(out, frame_cpu_.samples);
+  out << ",\n  \"passes\": [";
+  for (std::size_t i = 0; i < pass_cpu_.size(); ++i) {
+    out << (i == 0 ? "\n    " : ",\n    ") << "{\"name\": ";
+    writeString(out, pass_cpu_[i].name);
+    out << ", \"cpu_ms\": ";
+    writeStats(out, pass_cpu_[i].samples);
+    out << ", \"gpu_ms\": ";
+    writeStats(out, pass_gpu_[i].samples);
+    out << '}';
+  }
+  out << "\n  ],\n  \"systems_cpu_ms\": {";
+  for (std::size_t i = 0; i < systems_.size(); ++i) {
+    out << (i == 0 ? "\n    " : ",\n    ");
+    writeString(out, systems_[i].name);
+    out << ": ";
+    writeStats(out, systems_[i].samples);
+  }
+  out << "\n  },\n  \"counters\": {";
+  for (std::size_t i = 0; i < counters_.size(); ++i) {
+    out << (i == 0 ? "\n    " : ",\n    ");
+    writeString(out, counters_[i].name);
+    out << ": ";
+    writeStats(out, counters_[i].samples);
+  }
+  out << "\n  },\n  \"comparisons\": {";
+  for (std::size_t i = 0; i < comparisons_.size(); ++i) {
+    const auto &comparison = comparisons_[i];
+    out << (i == 0 ? "\n    " : ",\n    ");
+    writeString(out, comparison.name);
+    out << ": {\"baseline\": ";
+    writeString(out, comparison.baseline.name);
+    out << ", \"baseline_ms\": ";
+    writeStats(out, comparison.baseline.samples);
+    out << ", \"candidate\": ";
+    writeString(out, comparison.candidate.name);
+    out << ", \"candidate_ms\": ";
+    writeStats(out, comparison.candidate.samples);
+    out << ", \"speedup\": ";
+    if (comparison.baseline.samples.empty() ||
+        comparison.candidate.samples.empty() ||
+        getMedian(comparison.candidate.samples) <= 0.0) {
+      out << "null";
+    } else {
+      out << getMedian(comparison.baseline.samples) /
+                 getMedian(comparison.candidate.samples);
+    }
+    out << '}';
+  }
+  out << "\n  }\n}\n";
+}
+
+uint32_t Profiler::findPass(const char *name) {
+  for (uint32_t i = 0; i < pass_cpu_.size(); ++i) {
+    if (pass_cpu_[i].name == name) {
+      return i;
+    }
+  }
+  pass_cpu_.push_back({name});
+  pass_gpu_.push_back({name});
+  return uint32_t(pass_cpu_.size() - 1);
+}
+
+Profiler::Series &Profiler::findCounter(const char *name) {
+  for (auto &counter : counters_) {
+    if (counter.name == name) {
+      return counter;
+    }
+  }
+  return counters_.emplace_back(Series{name});
+}
+
+void Profiler::resolve(FrameQueries &frame) {
+  double gpu_frame_ms = 0.0;
+  for (const auto &pass : frame.passes) {
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(pass.begin, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(pass.end, GL_QUERY_RESULT, &end);
+    const double gpu_ms = double(end - begin) / 1.0e6;
+    pass_cpu_[pass.pass].samples.push_back(pass.cpu_ms);
+    pass_gpu_[pass.pass].samples.push_back(gpu_ms);
+    gpu_frame_ms += gpu_ms;
+  }
+  if (!frame.passes.empty()) {
+    last_gpu_frame_ms_ = gpu_frame_ms;
+  }
+  frame.passes.clear();
+  frame.pending = false;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <gl/all.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Collects per-pass CPU and GPU timings. GPU timings come from timestamp
+// queries which are read back `latency` frames later to avoid stalling.
+// Frames and passes are recorded by the thread owning the GL context,
+// counters, system times and infos may be set from any thread.
+class Profiler {
+public:
+  explicit Profiler(uint32_t latency = 4);
+  ~Profiler();
+
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  void beginFrame();
+  void endFrame();
+
+  void beginPass(const char *name);
+  void endPass();
+
+  void setCounter(const char *name, double value);
+  // CPU time a scheduler system took this frame.
+  void setSystemTime(const char *name, double ms);
+  void setInfo(const char *key, const std::string &value);
+  // Two variants of the same work timed side by side, written under
+  // "comparisons" with the ratio of their median times.
+  void addComparison(const char *name, const char *baseline,
+                     std::vector<double> baseline_ms, const char *candidate,
+                     std::vector<double> candidate_ms);
+
+  // Waits for all pending queries and records their results.
+  void flush();
+
+  uint64_t getFrameCount() const;
+  // GPU time of all passes of the most recently resolved frame, which is
+  // `latency` frames old. 0 until the first frame is resolved.
+  double getLastGpuFrameMs() const;
+  void writeJson(std::ostream &out) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Series {
+    std::string name;
+    std::vector<double> samples;
+  };
+
+  struct Comparison {
+    std::string name;
+    Series baseline;
+    Series candidate;
+  };
+
+  struct PassQuery {
+    uint32_t pass;
+    GLuint begin;
+    GLuint end;
+    double cpu_ms;
+  };
+
+  struct FrameQueries {
+    std::vector<GLuint> pool;
+    std::vector<PassQuery> passes;
+    bool pending{false};
+  };
+
+  uint32_t findPass(const char *name);
+  Series &findCounter(const char *name);
+  void resolve(FrameQueries &frame);
+
+  std::vector<FrameQueries> frames_;
+  std::vector<Series> pass_cpu_;
+  std::vector<Series> pass_gpu_;
+  std::vector<Series> counters_;
+  std::vector<Series> systems_;
+  Series frame_cpu_{"frame"};
+  std::vector<std::pair<std::string, std::string>> info_;
+  std::vector<Comparison> comparisons_;
+  // Guards counters_, systems_, info_ and comparisons_
+  mutable std::mutex mutex_{};
+
+  uint64_t frame_index_{0};
+  double last_gpu_frame_ms_{0.0};
+  Clock::time_point frame_start_{};
+  Clock::time_point pass_start_{};
+  int32_t open_pass_{-1};
+};
@@ -0,0 +1,404 @@
+#include "program_registry.h"
+#include "state_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ProgramCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t size;
+};
+
+constexpr char PROGRAM_CACHE_MAGIC[4] = {'W', 'S', 'P', 'B'};
+// Bump when the header or the hashed inputs change.
+constexpr uint32_t PROGRAM_CACHE_VERSION = 1;
+// How often the watcher checks whether it should stop
+constexpr int WATCH_POLL_MS = 200;
+
+GLenum getShaderStage(const std::string &path) {
+  const auto extension = std::filesystem::path(path).extension();
+  if (extension == ".vert") {
+    return GL_VERTEX_SHADER;
+  }
+  if (extension == ".frag") {
+    return GL_FRAGMENT_SHADER;
+  }
+  if (extension == ".comp") {
+    return GL_COMPUTE_SHADER;
+  }
+  return GL_NONE;
+}
+
+std::string makeKey(const std::vector<std::string> &paths,
+                    const std::vector<std::string> &defines) {
+  std::string key;
+  for (const auto &path : paths) {
+    key += key.empty() ? "" : " ";
+    key += path;
+  }
+  for (const auto &define : defines) {
+    key += " -D" + define;
+  }
+  return key;
+}
+
+std::vector<std::string> loadSources(const std::vector<std::string> &paths,
+                                     const std::vector<std::string> &defines) {
+  std::vector<std::string> sources;
+  sources.reserve(paths.size());
+  for (const auto &path : paths) {
+    sources.push_back(loadShaderSource(path.c_str(), defines));
+  }
+  return sources;
+}
+
+// 64-bit FNV-1a
+void hashBytes(uint64_t &hash, const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+}
+
+std::filesystem::path getCachePath(const std::string &cache_dir,
+                                   uint64_t hash) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bin",
+                static_cast<unsigned long long>(hash));
+  return std::filesystem::path(cache_dir) / name;
+}
+
+double toMs(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+ProgramRegistry::ProgramRegistry(std::string cache_dir, bool watch)
+    : cache_dir_{std::move(cache_dir)} {
+  GLint binary_formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_formats);
+  if (binary_formats == 0) {
+    cache_dir_.clear();
+  }
+  for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    driver_ += reinterpret_cast<const char *>(glGetString(name));
+    driver_ += '\n';
+  }
+
+#ifdef __linux__
+  if (watch) {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+      std::cerr << "Unable to watch shader sources\n";
+    } else {
+      watcher_ = std::thread([this] { runWatcher(); });
+    }
+  }
+#else
+  (void)watch;
+#endif
+}
+
+ProgramRegistry::~ProgramRegistry() {
+  stopping_ = true;
+  if (watcher_.joinable()) {
+    watcher_.join();
+  }
+#ifdef __linux__
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+  }
+#endif
+}
+
+Shader ProgramRegistry::load(const std::vector<std::string> &paths,
+                             const std::vector<std::string> &defines) {
+  const auto start = Clock::now();
+  const std::string key = makeKey(paths, defines);
+  {
+    std::lock_guard lock(mutex_);
+    if (const auto it = programs_.find(key); it != programs_.end()) {
+      return Shader(it->second.handle);
+    }
+  }
+
+  Program program{paths, defines, std::make_shared<ProgramHandle>()};
+  if (!build(program, loadSources(paths, defines), program.handle->program)) {
+    std::cerr << "Unable to build program: " << key << '\n';
+    exit(EXIT_FAILURE);
+  }
+  for (const auto &path : paths) {
+    watch(path);
+  }
+  const auto handle = program.handle;
+  {
+    std::lock_guard lock(mutex_);
+    programs_.emplace(key, std::move(program));
+  }
+  load_ms_ += toMs(Clock::now() - start);
+  return Shader(handle);
+}
+
+void ProgramRegistry::update() {
+  std::vector<Reload> reloads;
+  {
+    std::lock_guard lock(mutex_);
+    reloads.swap(reloads_);
+  }
+
+  for (const auto &reload : reloads) {
+    Program *program = nullptr;
+    {
+      std::lock_guard lock(mutex_);
+      program = &programs_.at(reload.key);
+    }
+    gl::program rebuilt;
+    if (!build(*program, reload.sources, rebuilt)) {
+      std::cerr << "Keeping the previous version of " << reload.key << '\n';
+      continue;
+    }
+    program->handle->program = std::move(rebuilt);
+    ++program->handle->generation;
+    // The replaced program may still be bound and GL can reuse its name.
+    StateCache::get().invalidate();
+    std::cout << "Reloaded " << reload.key << '\n';
+  }
+}
+
+uint32_t ProgramRegistry::getProgramCount() const {
+  std::lock_guard lock(mutex_);
+  return uint32_t(programs_.size());
+}
+
+uint32_t ProgramRegistry::getCacheHitCount() const { return cache_hits_; }
+
+uint32_t ProgramRegistry::getCompileCount() const { return compiles_; }
+
+double ProgramRegistry::getLoadMs() const { return load_ms_; }
+
+bool ProgramRegistry::build(const Program &program,
+                            const std::vector<std::string> &sources,
+                            gl::program &out) {
+  const uint64_t hash = hashSources(program, sources);
+  if (!cache_dir_.empty() && loadBinary(hash, out)) {
+    ++cache_hits_;
+    return true;
+  }
+
+  // Attached shaders live on until the program is deleted, so they can go
+  // out of scope before linking.
+  gl::program linked;
+  for (std::size_t i = 0; i < program.paths.size(); ++i) {
+    const GLenum stage = getShaderStage(program.paths[i]);
+    if (stage == GL_NONE) {
+      std::cerr << "Unknown shader stage: " << program.paths[i] << '\n';
+      return false;
+    }
+    gl::shader shader(stage);
+    shader.set_source(sources[i]);
+    if (!shader.compile()) {
+      std::cerr << "Shader compilation error in " << program.paths[i] << ": "
+                << shader.info_log() << '\n';
+      return false;
+    }
+    linked.attach_shader(shader);
+  }
+  glProgramParameteri(linked.id(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                      GL_TRUE);
+  if (!linked.link()) {
+    std::cerr << "Not linked: " << linked.info_log() << '\n';
+    return false;
+  }
+
+  ++compiles_;
+  if (!cache_dir_.empty()) {
+    storeBinary(hash, linked);
+  }
+  out = std::move(linked);
+  return true;
+}
+
+bool ProgramRegistry::loadBinary(uint64_t hash, gl::program &out) const {
+  const auto path = getCachePath(cache_dir_, hash);
+  std::ifstream in(path, std::ios::binary);
+  ProgramCacheHeader header{};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  const bool valid =
+      in &&
+      std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) ==
+          0 &&
+      header.version == PROGRAM_CACHE_VERSION;
+  if (!valid) {
+    return false;
+  }
+  std::vector<char> binary(header.size);
+  in.read(binary.data(), std::streamsize(binary.size()));
+  if (!in) {
+    return false;
+  }
+
+  gl::program program;
+  glProgramBinary(program.id(), header.format, binary.data(),
+                  GLsizei(binary.size()));
+  // Fails after a driver update, the caller compiles from source instead.
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program.id(), GL_LINK_STATUS, &linked);
+  if (linked != GL_TRUE) {
+    return false;
+  }
+  out = std::move(program);
+  return true;
+}
+
+void ProgramRegistry::storeBinary(uint64_t hash,
+                                  const gl::program &program) const {
+  GLint length = 0;
+  glGetProgramiv(program.id(), GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(std::size_t(length), 0);
+  GLenum format = GL_NONE;
+  glGetProgramBinary(program.id(), length, nullptr, &format, binary.data());
+
+  ProgramCacheHeader header{};
+  std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+  header.version = PROGRAM_CACHE_VERSION;
+  header.format = format;
+  header.size = uint32_t(binary.size());
+
+  // Written to a temporary file first like the mesh cache, so an
+  // interrupted write never leaves a truncated binary behind.
+  std::error_code error;
+  std::filesystem::create_directories(cache_dir_, error);
+  const auto path = getCachePath(cache_dir_, hash);
+  auto temp_path = path;
+  temp_path += ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(binary.data(), std::streamsize(binary.size()));
+    if (!out) {
+      std::cerr << "Unable to write program cache: " << path << '\n';
+      return;
+    }
+  }
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    std::cerr << "Unable to write program cache: " << path << '\n';
+  }
+}
+
+uint64_t ProgramRegistry::hashSources(
+    const Program &program, const std::vector<std::string> &sources) const {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  hashBytes(hash, &PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+  hashBytes(hash, driver_.data(), driver_.size());
+  for (std::size_t i = 0; i < sources.size(); ++i) {
+    const GLenum stage = getShaderStage(program.paths[i]);
+    hashBytes(hash, &stage, sizeof(stage));
+    hashBytes(hash, sources[i].data(), sources[i].size());
+  }
+  return hash;
+}
+
+void ProgramRegistry::watch(const std::string &path) {
+#ifdef __linux__
+  if (inotify_fd_ < 0) {
+    return;
+  }
+  // Directories are watched rather than files, editors often save by
+  // renaming a new file over the old one.
+  std::string dir = std::filesystem::path(path).parent_path().string();
+  if (dir.empty()) {
+    dir = ".";
+  }
+  std::lock_guard lock(mutex_);
+  for (const auto &[descriptor, watched] : watched_dirs_) {
+    if (watched == dir) {
+      return;
+    }
+  }
+  const int descriptor =
+      inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (descriptor >= 0) {
+    watched_dirs_[descriptor] = dir;
+  }
+#else
+  (void)path;
+#endif
+}
+
+void ProgramRegistry::runWatcher() {
+#ifdef __linux__
+  alignas(inotify_event) char buffer[4096];
+  while (!stopping_) {
+    pollfd descriptor{inotify_fd_, POLLIN, 0};
+    if (poll(&descriptor, 1, WATCH_POLL_MS) <= 0) {
+      continue;
+    }
+    const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+    for (ssize_t offset = 0; offset < length;) {
+      const auto *event =
+          reinterpret_cast<const inotify_event *>(buffer + offset);
+      if (event->len > 0) {
+        std::string dir;
+        {
+          std::lock_guard lock(mutex_);
+          if (const auto it = watched_dirs_.find(event->wd);
+              it != watched_dirs_.end()) {
+            dir = it->second;
+          }
+        }
+        if (!dir.empty()) {
+          queueReload((std::filesystem::path(dir) / event->name).string());
+        }
+      }
+      offset += ssize_t(sizeof(inotify_event) + event->len);
+    }
+  }
+#endif
+}
+
+void ProgramRegistry::queueReload(const std::string &path) {
+  const auto changed = std::filesystem::path(path).lexically_normal();
+  std::lock_guard lock(mutex_);
+  for (const auto &[key, program] : programs_) {
+    const bool uses_file = std::any_of(
+        program.paths.begin(), program.paths.end(), [&](const auto &source) {
+          return std::filesystem::path(source).lexically_normal() == changed;
+        });
+    if (!uses_file) {
+      continue;
+    }
+    // Sources are read here, off the GL thread. A later save of the same
+    // program replaces a reload that is still queued.
+    auto sources = loadSources(program.paths, program.defines);
+    const auto queued =
+        std::find_if(reloads_.begin(), reloads_.end(),
+                     [&](const Reload &reload) { return reload.key == key; });
+    if (queued != reloads_.end()) {
+      queued->sources = std::move(sources);
+    } else {
+      reloads_.push_back({key, std::move(sources)});
+    }
+  }
+}
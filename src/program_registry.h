@@ -0,0 +1,82 @@
+#pragma once
+
+#include "shader.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Builds every GL program from its GLSL files once, keyed by the paths and
+// defines. Linked programs are stored in `cache_dir` under a hash of the
+// preprocessed sources and the driver, and loaded with glProgramBinary on
+// the next start. When watching, an inotify thread reads saved sources and
+// update() swaps the rebuilt programs into the existing Shaders. Everything
+// but the watcher has to run on the thread owning the GL context.
+class ProgramRegistry {
+public:
+  // An empty cache_dir disables the binary cache.
+  ProgramRegistry(std::string cache_dir, bool watch);
+  ~ProgramRegistry();
+
+  ProgramRegistry(const ProgramRegistry &) = delete;
+  ProgramRegistry &operator=(const ProgramRegistry &) = delete;
+
+  // The stage of each file follows from its extension, .vert, .frag or
+  // .comp. Exits when the program can't be built.
+  Shader load(const std::vector<std::string> &paths,
+              const std::vector<std::string> &defines = {});
+
+  // Rebuilds the programs whose sources changed since the last call. A
+  // program that fails to build keeps its previous version.
+  void update();
+
+  uint32_t getProgramCount() const;
+  // Programs loaded from the binary cache and compiled from source
+  uint32_t getCacheHitCount() const;
+  uint32_t getCompileCount() const;
+  // Time spent in load()
+  double getLoadMs() const;
+
+private:
+  struct Program {
+    std::vector<std::string> paths;
+    std::vector<std::string> defines;
+    std::shared_ptr<ProgramHandle> handle;
+  };
+
+  struct Reload {
+    std::string key;
+    std::vector<std::string> sources;
+  };
+
+  bool build(const Program &program, const std::vector<std::string> &sources,
+             gl::program &out);
+  bool loadBinary(uint64_t hash, gl::program &out) const;
+  void storeBinary(uint64_t hash, const gl::program &program) const;
+  uint64_t hashSources(const Program &program,
+                       const std::vector<std::string> &sources) const;
+
+  void watch(const std::string &path);
+  void runWatcher();
+  void queueReload(const std::string &path);
+
+  std::string cache_dir_;
+  // Vendor, renderer and version, binaries only load on the same driver
+  std::string driver_{};
+  // Guards programs_, watched_dirs_ and reloads_ against the watcher
+  mutable std::mutex mutex_{};
+  std::unordered_map<std::string, Program> programs_{};
+  std::vector<Reload> reloads_{};
+  std::unordered_map<int, std::string> watched_dirs_{};
+  int inotify_fd_{-1};
+  std::thread watcher_{};
+  std::atomic<bool> stopping_{false};
+  uint32_t cache_hits_{0};
+  uint32_t compiles_{0};
+  double load_ms_{0.0};
+};
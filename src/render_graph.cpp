@@ -0,0 +1,350 @@
+#include "render_graph.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+constexpr GLbitfield IMAGE_WRITE_BARRIERS = GL_TEXTURE_FETCH_BARRIER_BIT |
+                                            GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                                            GL_FRAMEBUFFER_BARRIER_BIT;
+
+GLbitfield getBarrierBit(Access access) {
+  switch (access) {
+  case Access::Attachment:
+    return GL_FRAMEBUFFER_BARRIER_BIT;
+  case Access::Sampled:
+    return GL_TEXTURE_FETCH_BARRIER_BIT;
+  case Access::Image:
+    return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+  }
+  return 0;
+}
+
+std::string getBarrierNames(GLbitfield barriers) {
+  std::string names;
+  const auto append = [&](GLbitfield bit, const char *name) {
+    if ((barriers & bit) != 0) {
+      names += names.empty() ? name : std::string(" | ") + name;
+    }
+  };
+  append(GL_TEXTURE_FETCH_BARRIER_BIT, "texture fetch");
+  append(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, "image access");
+  append(GL_FRAMEBUFFER_BARRIER_BIT, "framebuffer");
+  return names;
+}
+
+double toMb(std::size_t bytes) { return double(bytes) / (1024.0 * 1024.0); }
+
+std::size_t getTextureBytes(const TextureDesc &desc) {
+  return std::size_t(desc.width) * std::size_t(desc.height) *
+         getBytesPerPixel(desc.format);
+}
+
+} // namespace
+
+ResourceHandle RenderGraph::createTexture(const std::string &name,
+                                          TextureDesc desc) {
+  if (compiled_) {
+    std::cerr << "Render graph already compiled, cannot add: " << name << '\n';
+    exit(EXIT_FAILURE);
+  }
+  resources_.push_back({name, desc});
+  return ResourceHandle(resources_.size() - 1);
+}
+
+ResourceHandle RenderGraph::importTexture(const std::string &name,
+                                          bool output) {
+  if (compiled_) {
+    std::cerr << "Render graph already compiled, cannot add: " << name << '\n';
+    exit(EXIT_FAILURE);
+  }
+  Resource resource{name};
+  resource.imported = true;
+  resource.output = output;
+  resources_.push_back(std::move(resource));
+  return ResourceHandle(resources_.size() - 1);
+}
+
+void RenderGraph::addPass(const std::string &name,
+                          std::vector<ResourceUse> reads,
+                          std::vector<ResourceUse> writes,
+                          std::function<void()> execute) {
+  if (compiled_) {
+    std::cerr << "Render graph already compiled, cannot add: " << name << '\n';
+    exit(EXIT_FAILURE);
+  }
+  passes_.push_back(
+      {name, std::move(reads), std::move(writes), std::move(execute)});
+}
+
+void RenderGraph::compile() {
+  plan();
+  allocateTextures();
+  compiled_ = true;
+}
+
+void RenderGraph::plan() {
+  cullPasses();
+  computeLifetimes();
+  assignTextures();
+  scheduleBarriers();
+}
+
+void RenderGraph::execute(Profiler &profiler) {
+  for (const auto &pass : passes_) {
+    if (pass.culled) {
+      continue;
+    }
+    profiler.beginPass(pass.name.c_str());
+    if (pass.barriers != 0) {
+      glMemoryBarrier(pass.barriers);
+    }
+    pass.execute();
+    profiler.endPass();
+  }
+}
+
+const gl::texture_2d &RenderGraph::getTexture(ResourceHandle resource) const {
+  const auto &entry = resources_[resource];
+  if (entry.texture < 0) {
+    std::cerr << "Render graph texture not allocated: " << entry.name << '\n';
+    exit(EXIT_FAILURE);
+  }
+  return textures_[entry.texture];
+}
+
+bool RenderGraph::isCulled(ResourceHandle resource) const {
+  const auto &entry = resources_[resource];
+  return !entry.imported && entry.first > entry.last;
+}
+
+void RenderGraph::addToMemoryReport(MemoryReport &report) const {
+  for (std::size_t i = 0; i < textures_.size(); ++i) {
+    std::string name;
+    for (const auto &resource : resources_) {
+      if (resource.texture == int32_t(i)) {
+        name += name.empty() ? resource.name : '+' + resource.name;
+      }
+    }
+    const auto &desc = texture_descs_[i];
+    report.add(name, desc.width, desc.height, desc.format);
+  }
+}
+
+void RenderGraph::printSummary(std::ostream &out) const {
+  out << "Render graph:\n  passes:";
+  for (const auto &pass : passes_) {
+    out << ' ' << pass.name << (pass.culled ? " (culled)" : "");
+  }
+  out << "\n  textures:\n";
+
+  std::size_t virtual_bytes = 0;
+  std::size_t allocated_bytes = 0;
+  std::size_t transient_count = 0;
+  for (const auto &desc : texture_descs_) {
+    allocated_bytes += getTextureBytes(desc);
+  }
+  for (const auto &resource : resources_) {
+    out << "    " << std::left << std::setw(18) << resource.name << std::right;
+    if (resource.imported) {
+      out << "imported\n";
+      continue;
+    }
+    if (resource.first > resource.last) {
+      out << "culled, no pass uses it\n";
+      continue;
+    }
+    virtual_bytes += getTextureBytes(resource.desc);
+    ++transient_count;
+    out << "passes " << resource.first << '-' << resource.last
+        << ", texture " << resource.texture << '\n';
+  }
+
+  out << "  barriers:\n";
+  bool any_barrier = false;
+  for (const auto &pass : passes_) {
+    if (!pass.culled && pass.barriers != 0) {
+      out << "    before " << pass.name << ": "
+          << getBarrierNames(pass.barriers) << '\n';
+      any_barrier = true;
+    }
+  }
+  if (!any_barrier) {
+    out << "    none\n";
+  }
+  out << std::fixed << std::setprecision(2) << "  transient "
+      << toMb(allocated_bytes) << " MB allocated for " << toMb(virtual_bytes)
+      << " MB of textures, "
+      << transient_count - texture_descs_.size() << " shared\n"
+      << std::defaultfloat;
+}
+
+void RenderGraph::cullPasses() {
+  std::vector<bool> needed(resources_.size());
+  for (std::size_t i = 0; i < resources_.size(); ++i) {
+    needed[i] = resources_[i].output;
+  }
+  for (std::size_t i = passes_.size(); i-- > 0;) {
+    auto &pass = passes_[i];
+    pass.culled = std::none_of(
+        pass.writes.begin(), pass.writes.end(),
+        [&](const ResourceUse &use) { return needed[use.resource]; });
+    if (pass.culled) {
+      continue;
+    }
+    for (const auto &read : pass.reads) {
+      needed[read.resource] = true;
+    }
+  }
+}
+
+void RenderGraph::computeLifetimes() {
+  uint32_t index = 0;
+  for (const auto &pass : passes_) {
+    if (pass.culled) {
+      continue;
+    }
+    for (const auto *uses : {&pass.reads, &pass.writes}) {
+      for (const auto &use : *uses) {
+        auto &resource = resources_[use.resource];
+        resource.first = std::min(resource.first, index);
+        resource.last = std::max(resource.last, index);
+      }
+    }
+    ++index;
+  }
+}
+
+void RenderGraph::assignTextures() {
+  std::vector<ResourceHandle> order(resources_.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(),
+            [&](ResourceHandle lhs, ResourceHandle rhs) {
+              return resources_[lhs].first < resources_[rhs].first;
+            });
+
+  // Last pass using each texture so far. A transient can take over a
+  // texture of the same description once its previous user is done.
+  std::vector<uint32_t> texture_last;
+  for (const auto handle : order) {
+    auto &resource = resources_[handle];
+    if (resource.imported || resource.first > resource.last) {
+      continue;
+    }
+    for (std::size_t i = 0; i < texture_descs_.size(); ++i) {
+      if (texture_descs_[i] == resource.desc &&
+          texture_last[i] < resource.first) {
+        resource.texture = int32_t(i);
+        break;
+      }
+    }
+    if (resource.texture < 0) {
+      resource.texture = int32_t(texture_descs_.size());
+      texture_descs_.push_back(resource.desc);
+      texture_last.push_back(0);
+    }
+    texture_last[resource.texture] = resource.last;
+  }
+}
+
+void RenderGraph::allocateTextures() {
+  for (const auto &desc : texture_descs_) {
+    gl::texture_2d texture;
+    texture.set_min_filter(GL_LINEAR);
+    texture.set_mag_filter(GL_LINEAR);
+    texture.set_wrap_s(GL_REPEAT);
+    texture.set_wrap_t(GL_REPEAT);
+    texture.set_storage(1, desc.format, desc.width, desc.height);
+    textures_.push_back(std::move(texture));
+  }
+}
+
+void RenderGraph::scheduleBarriers() {
+  // Barriers still owed for image stores, per resource. The passes are
+  // walked twice so stores at the end of a frame are covered at the start
+  // of the next one. Stores are tracked per GL texture, aliases of one
+  // texture wait for each other's stores.
+  const std::size_t texture_count = texture_descs_.size();
+  const auto get_slot = [&](ResourceHandle handle) {
+    const auto &resource = resources_[handle];
+    return resource.imported ? texture_count + handle
+                             : std::size_t(resource.texture);
+  };
+  std::vector<GLbitfield> pending(texture_count + resources_.size(), 0);
+  for (int round = 0; round < 2; ++round) {
+    for (auto &pass : passes_) {
+      if (pass.culled) {
+        continue;
+      }
+      GLbitfield barriers = 0;
+      for (const auto *uses : {&pass.reads, &pass.writes}) {
+        for (const auto &use : *uses) {
+          barriers |=
+              pending[get_slot(use.resource)] & getBarrierBit(use.access);
+        }
+      }
+      // A barrier makes every earlier store visible, not just the ones of
+      // the resources this pass uses.
+      for (auto &bits : pending) {
+        bits &= ~barriers;
+      }
+      for (const auto &write : pass.writes) {
+        if (write.access == Access::Image) {
+          pending[get_slot(write.resource)] = IMAGE_WRITE_BARRIERS;
+        }
+      }
+      pass.barriers = barriers;
+    }
+  }
+}
+
+bool RenderGraph::selfCheck(std::ostream &errors) {
+  //   produce   stores a            (image)
+  //   consume   samples a, draws b
+  //   reuse     samples b, stores c (image, same description as a)
+  //   present   samples c, draws the output
+  RenderGraph graph;
+  const TextureDesc shared_desc{64, 64, GL_RGBA16F};
+  const auto a = graph.createTexture("a", shared_desc);
+  const auto b = graph.createTexture("b", {64, 64, GL_RGBA8});
+  const auto c = graph.createTexture("c", shared_desc);
+  const auto output = graph.importTexture("output", true);
+  const auto nothing = [] {};
+  graph.addPass("produce", {}, {{a, Access::Image}}, nothing);
+  graph.addPass("consume", {{a, Access::Sampled}}, {{b, Access::Attachment}},
+                nothing);
+  graph.addPass("reuse", {{b, Access::Sampled}}, {{c, Access::Image}},
+                nothing);
+  graph.addPass("present", {{c, Access::Sampled}},
+                {{output, Access::Attachment}}, nothing);
+  graph.plan();
+
+  bool passed = true;
+  const auto expect = [&](bool condition, const char *message) {
+    if (!condition) {
+      errors << "Render graph self-check failed: " << message << '\n';
+      passed = false;
+    }
+  };
+  const auto &resources = graph.resources_;
+  expect(resources[a].texture == resources[c].texture,
+         "a and c do not share a texture");
+  expect(resources[a].texture != resources[b].texture,
+         "b shares a texture of another description");
+  expect(graph.texture_descs_.size() == 2, "expected 2 textures");
+  expect((graph.passes_[1].barriers & GL_TEXTURE_FETCH_BARRIER_BIT) != 0,
+         "consume misses the texture fetch barrier for a");
+  expect((graph.passes_[3].barriers & GL_TEXTURE_FETCH_BARRIER_BIT) != 0,
+         "present misses the texture fetch barrier for c");
+  expect((graph.passes_[0].barriers & GL_SHADER_IMAGE_ACCESS_BARRIER_BIT) !=
+             0,
+         "produce misses the image barrier for last frame's stores to c");
+  expect((graph.passes_[2].barriers & GL_SHADER_IMAGE_ACCESS_BARRIER_BIT) !=
+             0,
+         "reuse misses the image barrier for the stores to a");
+  return passed;
+}
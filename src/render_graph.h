@@ -0,0 +1,109 @@
+#pragma once
+
+#include "render_targets.h"
+
+#include <gl/all.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Profiler;
+
+struct TextureDesc {
+  int width;
+  int height;
+  GLenum format;
+
+  bool operator==(const TextureDesc &) const = default;
+};
+
+// How a pass touches a texture. Only image stores are incoherent in GL, so
+// this decides which barrier a reader of an image written by compute needs.
+enum class Access {
+  Attachment,
+  Sampled,
+  Image,
+};
+
+using ResourceHandle = uint32_t;
+
+struct ResourceUse {
+  ResourceHandle resource;
+  Access access;
+};
+
+// Graph of the passes that make up a frame. Passes declare the textures they
+// read and write in execution order. compile() then
+//  - culls passes whose results never reach an output and textures no
+//    remaining pass touches,
+//  - computes the lifetime of every transient texture and lets transients
+//    with identical descriptions and disjoint lifetimes share one GL
+//    texture,
+//  - records the glMemoryBarrier bits each pass needs before it runs.
+// The graph is built and compiled once, execute() runs it every frame.
+class RenderGraph {
+public:
+  // Texture allocated by compile(), valid until the graph is destroyed.
+  ResourceHandle createTexture(const std::string &name, TextureDesc desc);
+  // Texture owned outside the graph, e.g. the default framebuffer or history
+  // that lives across frames. Outputs keep the passes writing them alive.
+  ResourceHandle importTexture(const std::string &name, bool output);
+
+  void addPass(const std::string &name, std::vector<ResourceUse> reads,
+               std::vector<ResourceUse> writes,
+               std::function<void()> execute);
+
+  void compile();
+  void execute(Profiler &profiler);
+
+  const gl::texture_2d &getTexture(ResourceHandle resource) const;
+  bool isCulled(ResourceHandle resource) const;
+
+  // Adds every allocated texture, aliases once.
+  void addToMemoryReport(MemoryReport &report) const;
+  void printSummary(std::ostream &out) const;
+
+  // Plans a small graph where two transients of one description have
+  // disjoint lifetimes, and checks that they share a texture and that the
+  // readers of image stores get their barriers. The frame graph has no
+  // such pair. Reports failures to `errors`. Needs no GL context.
+  static bool selfCheck(std::ostream &errors);
+
+private:
+  struct Resource {
+    std::string name;
+    TextureDesc desc{};
+    bool imported{false};
+    bool output{false};
+    // Lifetime in compiled pass indices, first > last when culled
+    uint32_t first{UINT32_MAX};
+    uint32_t last{0};
+    int32_t texture{-1};
+  };
+
+  struct Pass {
+    std::string name;
+    std::vector<ResourceUse> reads;
+    std::vector<ResourceUse> writes;
+    std::function<void()> execute;
+    bool culled{false};
+    GLbitfield barriers{0};
+  };
+
+  // Everything compile() does but creating the GL textures
+  void plan();
+  void cullPasses();
+  void computeLifetimes();
+  void assignTextures();
+  void scheduleBarriers();
+  void allocateTextures();
+
+  std::vector<Resource> resources_{};
+  std::vector<Pass> passes_{};
+  std::vector<gl::texture_2d> textures_{};
+  std::vector<TextureDesc> texture_descs_{};
+  bool compiled_{false};
+};
@@ -0,0 +1,140 @@
+#include "render_targets.h"
+
+#include <fstream>
+#include <iomanip>
+
+namespace {
+
+struct FormatInfo {
+  const char *name;
+  GLenum format;
+  std::size_t bytes_per_pixel;
+};
+
+constexpr FormatInfo FORMATS[] = {
+    {"rgb32f", GL_RGB32F, 12},
+    {"rgba32f", GL_RGBA32F, 16},
+    {"rgba16f", GL_RGBA16F, 8},
+    {"r11g11b10f", GL_R11F_G11F_B10F, 4},
+    {"rg16f", GL_RG16F, 4},
+    {"rgba8", GL_RGBA8, 4},
+    {"rg8", GL_RG8, 2},
+    {"depth24_stencil8", GL_DEPTH24_STENCIL8, 4},
+};
+
+const FormatInfo *findFormat(GLenum format) {
+  for (const auto &info : FORMATS) {
+    if (info.format == format) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+std::optional<TargetPreset> parseTargetPreset(const std::string &name) {
+  if (name == "full") {
+    return TargetPreset::Full;
+  }
+  if (name == "half") {
+    return TargetPreset::Half;
+  }
+  if (name == "compact") {
+    return TargetPreset::Compact;
+  }
+  return std::nullopt;
+}
+
+std::optional<GLenum> parseTextureFormat(const std::string &name) {
+  for (const auto &info : FORMATS) {
+    if (name == info.name) {
+      return info.format;
+    }
+  }
+  return std::nullopt;
+}
+
+const char *getTextureFormatName(GLenum format) {
+  const auto *info = findFormat(format);
+  return info ? info->name : "unknown";
+}
+
+std::size_t getBytesPerPixel(GLenum format) {
+  const auto *info = findFormat(format);
+  return info ? info->bytes_per_pixel : 0;
+}
+
+RenderTargetFormats getRenderTargetFormats(TargetPreset preset) {
+  switch (preset) {
+  case TargetPreset::Half:
+    return {GL_RGBA16F, GL_RGBA16F};
+  case TargetPreset::Compact:
+    // The scene and composed colors are never negative, which is all the
+    // unsigned 11/10-bit floats cannot represent.
+    return {GL_R11F_G11F_B10F, GL_R11F_G11F_B10F};
+  default:
+    return {GL_RGB32F, GL_RGB32F};
+  }
+}
+
+void MemoryReport::add(const std::string &name, int width, int height,
+                       GLenum format) {
+  entries_.push_back({name, width, height, format,
+                      std::size_t(width) * std::size_t(height) *
+                          getBytesPerPixel(format)});
+}
+
+std::size_t MemoryReport::getTotalBytes() const {
+  std::size_t total = 0;
+  for (const auto &entry : entries_) {
+    total += entry.bytes;
+  }
+  return total;
+}
+
+void MemoryReport::print(std::ostream &out) const {
+  const auto to_mb = [](std::size_t bytes) {
+    return double(bytes) / (1024.0 * 1024.0);
+  };
+  out << "Render targets:\n" << std::fixed << std::setprecision(2);
+  for (const auto &entry : entries_) {
+    out << "  " << std::left << std::setw(24) << entry.name << std::right
+        << std::setw(5) << entry.width << 'x' << std::left << std::setw(5)
+        << entry.height << std::setw(18) << getTextureFormatName(entry.format)
+        << std::right << std::setw(8) << to_mb(entry.bytes) << " MB\n";
+  }
+  out << "  total " << to_mb(getTotalBytes()) << " MB\n";
+  out << std::defaultfloat;
+}
+
+bool captureFramebuffer(const std::string &path, int width, int height) {
+  std::vector<unsigned char> pixels(std::size_t(width) * height * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    return false;
+  }
+  out << "P6\n" << width << ' ' << height << "\n255\n";
+  // OpenGL rows start at the bottom, PPM rows at the top.
+  for (int y = height - 1; y >= 0; --y) {
+    out.write(reinterpret_cast<const char *>(pixels.data()) +
+                  std::size_t(y) * width * 3,
+              std::streamsize(width) * 3);
+  }
+  return bool(out);
+}
+
+FloatImage readTextureImage(const gl::texture_2d &texture) {
+  int width = 0;
+  int height = 0;
+  glGetTextureLevelParameteriv(texture.id(), 0, GL_TEXTURE_WIDTH, &width);
+  glGetTextureLevelParameteriv(texture.id(), 0, GL_TEXTURE_HEIGHT, &height);
+  FloatImage image(width, height);
+  glGetTextureImage(texture.id(), 0, GL_RGBA, GL_FLOAT,
+                    GLsizei(image.pixels.size() * sizeof(glm::vec4)),
+                    image.pixels.data());
+  return image;
+}
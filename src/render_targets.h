@@ -0,0 +1,56 @@
+#pragma once
+
+#include "post_process_cpu.h"
+
+#include <gl/all.hpp>
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class TargetPreset {
+  // 32-bit float, the reference everything else is compared against
+  Full,
+  Half,
+  Compact,
+};
+
+struct RenderTargetFormats {
+  GLenum color;
+  GLenum hdr;
+};
+
+std::optional<TargetPreset> parseTargetPreset(const std::string &name);
+std::optional<GLenum> parseTextureFormat(const std::string &name);
+const char *getTextureFormatName(GLenum format);
+std::size_t getBytesPerPixel(GLenum format);
+
+RenderTargetFormats getRenderTargetFormats(TargetPreset preset);
+
+// Accumulates the size of every render target allocated at startup.
+class MemoryReport {
+public:
+  void add(const std::string &name, int width, int height, GLenum format);
+  std::size_t getTotalBytes() const;
+  void print(std::ostream &out) const;
+
+private:
+  struct Entry {
+    std::string name;
+    int width;
+    int height;
+    GLenum format;
+    std::size_t bytes;
+  };
+
+  std::vector<Entry> entries_{};
+};
+
+// Writes the color buffer of the bound read framebuffer as binary PPM.
+bool captureFramebuffer(const std::string &path, int width, int height);
+
+// Reads level 0 of a texture as RGBA floats, e.g. for the CPU kernels in
+// post_process_cpu.h.
+FloatImage readTextureImage(const gl::texture_2d &texture);
@@ -0,0 +1,49 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double SMOOTHING = 0.1;
+// No change while the frame time is within this fraction of the budget
+constexpr double TOLERANCE = 0.1;
+constexpr float MAX_STEP = 0.1f;
+// Roughly the profiler latency, so the next decision sees the last change
+constexpr uint32_t COOLDOWN_FRAMES = 8;
+
+} // namespace
+
+ResolutionController::ResolutionController(double budget_ms, float min_scale,
+                                           float max_scale)
+    : budget_ms_{budget_ms}, min_scale_{min_scale}, max_scale_{max_scale},
+      scale_{max_scale} {}
+
+void ResolutionController::update(double gpu_frame_ms) {
+  if (gpu_frame_ms <= 0.0 || budget_ms_ <= 0.0) {
+    return;
+  }
+  smoothed_ms_ = smoothed_ms_ == 0.0
+                     ? gpu_frame_ms
+                     : smoothed_ms_ + SMOOTHING * (gpu_frame_ms - smoothed_ms_);
+  if (cooldown_ > 0) {
+    --cooldown_;
+    return;
+  }
+
+  const double ratio = budget_ms_ / smoothed_ms_;
+  if (std::abs(ratio - 1.0) < TOLERANCE) {
+    return;
+  }
+  // The scaled passes cost roughly their texel count, the square of the
+  // scale.
+  const float target = scale_ * float(std::sqrt(ratio));
+  const float step = std::clamp(target - scale_, -MAX_STEP, MAX_STEP);
+  const float scale = std::clamp(scale_ + step, min_scale_, max_scale_);
+  if (scale != scale_) {
+    scale_ = scale;
+    cooldown_ = COOLDOWN_FRAMES;
+  }
+}
+
+float ResolutionController::getScale() const { return scale_; }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Picks the resolution scale of the passes that can run below full size so
+// that the GPU frame time stays within a budget. The measured time is
+// smoothed and the scale only moves when it is clearly over or under the
+// budget, in bounded steps, so it does not oscillate with the GPU timer
+// latency.
+class ResolutionController {
+public:
+  ResolutionController(double budget_ms, float min_scale, float max_scale);
+
+  // Feeds the GPU time of a finished frame, 0 when none is available yet.
+  void update(double gpu_frame_ms);
+  float getScale() const;
+
+private:
+  double budget_ms_;
+  float min_scale_;
+  float max_scale_;
+  float scale_;
+  double smoothed_ms_{0.0};
+  // Frames left before the scale may change again
+  uint32_t cooldown_{0};
+};
@@ -0,0 +1,301 @@
+#include "scene_renderer.h"
+#include "state_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+// How far past the edge of its size band an instance has to be before it
+// leaves its LOD, so instances near an edge don't switch every frame.
+constexpr float LOD_HYSTERESIS = 0.1f;
+
+constexpr Uniform<std::span<const glm::vec4>, "frustum_planes"> FRUSTUM_PLANES;
+constexpr Uniform<int, "instance_count"> INSTANCE_COUNT;
+
+// Same transform as cull.comp: the sphere center follows the model matrix and
+// the radius grows with the largest axis scale.
+glm::vec4 transformSphere(const glm::mat4 &model, const Bounds &bounds) {
+  const glm::vec3 center = model * glm::vec4(bounds.center, 1.0f);
+  const float scale = std::max({glm::length(glm::vec3(model[0])),
+                                glm::length(glm::vec3(model[1])),
+                                glm::length(glm::vec3(model[2]))});
+  return glm::vec4(center, bounds.radius * scale);
+}
+
+// Radius of the sphere's projection in units of half the screen height, the
+// same as its diameter as a fraction of the screen height.
+float getProjectedSize(const glm::vec4 &sphere, const glm::vec3 &eye,
+                       float projection_scale) {
+  const glm::vec3 offset = glm::vec3(sphere) - eye;
+  const float tangent_squared = glm::dot(offset, offset) - sphere.w * sphere.w;
+  if (tangent_squared <= 0.0f) {
+    // The camera is inside the sphere.
+    return std::numeric_limits<float>::max();
+  }
+  return sphere.w * projection_scale / std::sqrt(tangent_squared);
+}
+
+// LOD n is meant for sizes from lod_screen_size / 2^n up to twice that, LOD
+// 0 for everything larger.
+uint32_t chooseLod(float size, uint32_t current, uint32_t lod_count,
+                   float lod_screen_size) {
+  uint32_t target = 0;
+  float threshold = lod_screen_size;
+  while (target + 1 < lod_count && size < threshold) {
+    ++target;
+    threshold *= 0.5f;
+  }
+  if (target > current) {
+    const float lower_edge = std::ldexp(lod_screen_size, -int(current));
+    return size < lower_edge * (1.0f - LOD_HYSTERESIS) ? target : current;
+  }
+  if (target < current) {
+    const float upper_edge = std::ldexp(lod_screen_size, 1 - int(current));
+    return size > upper_edge * (1.0f + LOD_HYSTERESIS) ? target : current;
+  }
+  return current;
+}
+
+} // namespace
+
+uint8_t stencilValue(StencilClass stencil) {
+  switch (stencil) {
+  case StencilClass::Interesting:
+    return 0x4;
+  case StencilClass::Trace:
+    return 0x8;
+  default:
+    return 0x0;
+  }
+}
+
+SceneRenderer::SceneRenderer(ProgramRegistry &programs, CullingMode culling,
+                             float lod_screen_size)
+    : culling_{culling}, lod_screen_size_{lod_screen_size},
+      cull_shader_{programs.load({"../assets/cull.comp"})} {}
+
+void SceneRenderer::prepare(const FramePacket &packet) {
+  collect(packet);
+  visible_count_ = 0;
+  draw_count_ = 0;
+  if (instances_.empty()) {
+    return;
+  }
+  instance_buffer_.set_data(sizeof(InstanceData) * instances_.size(),
+                            instances_.data());
+
+  const auto planes = extractFrustumPlanes(packet.proj * packet.view);
+  switch (culling_) {
+  case CullingMode::Off:
+    buildCommands();
+    visible_.resize(instances_.size());
+    std::iota(visible_.begin(), visible_.end(), 0u);
+    visible_count_ = uint32_t(instances_.size());
+    break;
+  case CullingMode::Cpu:
+    cullCpu(planes);
+    break;
+  case CullingMode::Gpu:
+    cullGpu(planes);
+    return;
+  }
+
+  visible_buffer_.set_data(sizeof(uint32_t) * visible_.size(),
+                           visible_.data());
+  command_buffer_.set_data(sizeof(DrawCommand) * commands_.size(),
+                           commands_.data());
+}
+
+void SceneRenderer::draw() {
+  if (instances_.empty()) {
+    return;
+  }
+
+  instance_buffer_.bind_base(GL_SHADER_STORAGE_BUFFER, 0);
+  visible_buffer_.bind_base(GL_SHADER_STORAGE_BUFFER, 1);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_.id());
+
+  auto &state = StateCache::get();
+  for (std::size_t i = 0; i < batches_.size(); ++i) {
+    // The GPU writes its instance counts, so every batch has to be issued.
+    if (culling_ != CullingMode::Gpu && commands_[i].instance_count == 0) {
+      continue;
+    }
+    const auto &batch = batches_[i];
+    state.setStencilFunction(GL_ALWAYS, stencilValue(batch.stencil), 0xff);
+    batch.mesh->bind();
+    glDrawElementsIndirect(
+        GL_TRIANGLES, batch.mesh->getIndexType(),
+        reinterpret_cast<const void *>(sizeof(DrawCommand) * i));
+    ++draw_count_;
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+CullingMode SceneRenderer::getCullingMode() const { return culling_; }
+
+uint32_t SceneRenderer::getDrawCount() const { return draw_count_; }
+
+uint32_t SceneRenderer::getInstanceCount() const {
+  return uint32_t(instances_.size());
+}
+
+uint32_t SceneRenderer::getVisibleCount() const {
+  return culling_ == CullingMode::Gpu ? getInstanceCount() : visible_count_;
+}
+
+uint32_t SceneRenderer::getLodInstanceCount(uint32_t lod) const {
+  return lod < lod_counts_.size() ? lod_counts_[lod] : 0;
+}
+
+void SceneRenderer::collect(const FramePacket &packet) {
+  instances_.clear();
+  batches_.clear();
+  lod_counts_.fill(0);
+  const auto &items = packet.items;
+  const glm::vec3 eye = glm::inverse(packet.view)[3];
+  item_lods_.resize(items.size());
+  item_order_.clear();
+  for (uint32_t i = 0; i < items.size(); ++i) {
+    if (!items[i].mesh->isReady()) {
+      continue;
+    }
+    item_lods_[i] = selectLod(items[i], eye, packet.proj[1][1]);
+    ++lod_counts_[item_lods_[i]];
+    item_order_.push_back(i);
+  }
+  // Items are sorted by stencil class and mesh, the LOD splits those runs
+  // further. The sort is stable, so instances stay front to back.
+  std::stable_sort(item_order_.begin(), item_order_.end(),
+                   [&](uint32_t lhs, uint32_t rhs) {
+                     if (items[lhs].stencil != items[rhs].stencil) {
+                       return items[lhs].stencil < items[rhs].stencil;
+                     }
+                     if (items[lhs].mesh != items[rhs].mesh) {
+                       return std::less<>{}(items[lhs].mesh, items[rhs].mesh);
+                     }
+                     return item_lods_[lhs] < item_lods_[rhs];
+                   });
+
+  // Batches are runs of the same stencil class, mesh and LOD.
+  for (const uint32_t i : item_order_) {
+    const auto &item = items[i];
+    const uint32_t lod = item_lods_[i];
+    if (batches_.empty() || batches_.back().stencil != item.stencil ||
+        batches_.back().mesh != item.mesh || batches_.back().lod != lod) {
+      batches_.push_back({item.stencil, item.mesh, lod,
+                          uint32_t(instances_.size()), 0, item.distance});
+    }
+    instances_.push_back({item.model, item.color});
+    ++batches_.back().instance_count;
+  }
+
+  // Batches keep their instance ranges, only the draw order changes: the
+  // batch with the closest instance is drawn first.
+  std::sort(batches_.begin(), batches_.end(),
+            [](const Batch &lhs, const Batch &rhs) {
+              return lhs.distance < rhs.distance;
+            });
+
+  cull_items_.resize(instances_.size());
+  for (std::size_t b = 0; b < batches_.size(); ++b) {
+    const auto &batch = batches_[b];
+    const auto &bounds = batch.mesh->getBounds();
+    for (uint32_t i = batch.first_instance;
+         i < batch.first_instance + batch.instance_count; ++i) {
+      cull_items_[i] = {glm::vec4(bounds.center, bounds.radius), uint32_t(b),
+                        {}};
+    }
+  }
+}
+
+void SceneRenderer::buildCommands() {
+  commands_.clear();
+  for (const auto &batch : batches_) {
+    const MeshLod &lod = batch.mesh->getLod(batch.lod);
+    commands_.push_back({lod.index_count, batch.instance_count,
+                         lod.first_index, 0, batch.first_instance});
+  }
+}
+
+void SceneRenderer::cullCpu(const FrustumPlanes &planes) {
+  spheres_.clear();
+  for (std::size_t i = 0; i < instances_.size(); ++i) {
+    // cull_items_ holds the mesh bounds of every instance.
+    const glm::vec4 &local = cull_items_[i].sphere;
+    const auto sphere =
+        transformSphere(instances_[i].model, {glm::vec3(local), local.w});
+    spheres_.push(glm::vec3(sphere), sphere.w);
+  }
+  visibility_.resize(instances_.size());
+  cullSpheres(planes, spheres_, visibility_.data());
+
+  // Visible instances are compacted to the front of their batch's range.
+  buildCommands();
+  visible_.resize(instances_.size());
+  for (std::size_t b = 0; b < batches_.size(); ++b) {
+    const auto &batch = batches_[b];
+    uint32_t count = 0;
+    for (uint32_t i = batch.first_instance;
+         i < batch.first_instance + batch.instance_count; ++i) {
+      if (visibility_[i] != 0) {
+        visible_[batch.first_instance + count++] = i;
+      }
+    }
+    commands_[b].instance_count = count;
+    visible_count_ += count;
+  }
+}
+
+void SceneRenderer::cullGpu(const FrustumPlanes &planes) {
+  buildCommands();
+  for (auto &command : commands_) {
+    command.instance_count = 0;
+  }
+  command_buffer_.set_data(sizeof(DrawCommand) * commands_.size(),
+                           commands_.data());
+  cull_buffer_.set_data(sizeof(CullItem) * cull_items_.size(),
+                        cull_items_.data());
+  visible_buffer_.set_data(sizeof(uint32_t) * instances_.size(), nullptr);
+
+  instance_buffer_.bind_base(GL_SHADER_STORAGE_BUFFER, 0);
+  visible_buffer_.bind_base(GL_SHADER_STORAGE_BUFFER, 1);
+  cull_buffer_.bind_base(GL_SHADER_STORAGE_BUFFER, 2);
+  command_buffer_.bind_base(GL_SHADER_STORAGE_BUFFER, 3);
+
+  const auto count = uint32_t(instances_.size());
+  cull_shader_.use();
+  cull_shader_.set(FRUSTUM_PLANES, planes);
+  cull_shader_.set(INSTANCE_COUNT, int(count));
+  glDispatchCompute((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+uint32_t SceneRenderer::selectLod(const DrawItem &item, const glm::vec3 &eye,
+                                  float projection_scale) {
+  const auto index = std::size_t(entt::to_entity(item.entity));
+  if (index >= entity_lods_.size()) {
+    entity_lods_.resize(index + 1, 0);
+  }
+  const uint32_t lod_count = item.mesh->getLodCount();
+  if (lod_screen_size_ <= 0.0f || lod_count < 2) {
+    entity_lods_[index] = 0;
+    return 0;
+  }
+
+  // Entity indices are recycled, a new entity may start from the LOD of a
+  // destroyed one and settles within a frame.
+  const uint32_t current =
+      std::min(uint32_t(entity_lods_[index]), lod_count - 1);
+  const float size = getProjectedSize(
+      transformSphere(item.model, item.mesh->getBounds()), eye,
+      projection_scale);
+  const uint32_t lod = chooseLod(size, current, lod_count, lod_screen_size_);
+  entity_lods_[index] = uint8_t(lod);
+  return lod;
+}
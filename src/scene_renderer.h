@@ -0,0 +1,114 @@
+#pragma once
+
+#include "culling.h"
+#include "frame_packet.h"
+#include "program_registry.h"
+#include "shader.h"
+
+#include <gl/all.hpp>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+uint8_t stencilValue(StencilClass stencil);
+
+// Per-instance data read by object.vert, laid out as std430.
+struct InstanceData {
+  glm::mat4 model;
+  glm::vec4 color;
+};
+
+// Projected size, as a fraction of the screen height, below which meshes
+// switch to their first simplified LOD. Each further LOD takes half the
+// size.
+constexpr float LOD_SCREEN_SIZE = 0.25f;
+
+// Draws the items of a FramePacket with one indirect draw per (stencil
+// class, mesh, LOD) triple, batches and the instances inside them ordered
+// front to back. Instances
+// outside the view frustum are culled either on the GPU by
+// cull.comp or on the CPU, both write the indices of visible instances that
+// object.vert reads through gl_BaseInstance.
+class SceneRenderer {
+public:
+  // A lod_screen_size of 0 always draws the full meshes.
+  explicit SceneRenderer(ProgramRegistry &programs,
+                         CullingMode culling = CullingMode::Gpu,
+                         float lod_screen_size = LOD_SCREEN_SIZE);
+
+  // Batches and culls the packet's items. Changes the bound program in GPU
+  // mode so it has to be called before the object shader is bound.
+  void prepare(const FramePacket &packet);
+  // Can be called several times per frame, e.g. for a depth pre-pass.
+  void draw();
+
+  CullingMode getCullingMode() const;
+  // Draws issued since the last prepare().
+  uint32_t getDrawCount() const;
+  uint32_t getInstanceCount() const;
+  // Unknown on the CPU in GPU mode, where all instances are reported.
+  uint32_t getVisibleCount() const;
+  // Instances drawn with `lod` since the last prepare(), before culling
+  uint32_t getLodInstanceCount(uint32_t lod) const;
+
+private:
+  struct Batch {
+    StencilClass stencil;
+    Mesh *mesh;
+    uint32_t lod;
+    uint32_t first_instance;
+    uint32_t instance_count;
+    // Squared camera distance of the closest instance
+    float distance;
+  };
+
+  // Per-instance input of cull.comp, laid out as std430.
+  struct CullItem {
+    glm::vec4 sphere;
+    uint32_t batch;
+    uint32_t padding[3];
+  };
+
+  // DrawElementsIndirectCommand
+  struct DrawCommand {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+  };
+
+  void collect(const FramePacket &packet);
+  // Picks the LOD of an item from its projected size and the LOD it had in
+  // the previous frame.
+  uint32_t selectLod(const DrawItem &item, const glm::vec3 &eye,
+                     float projection_scale);
+  void buildCommands();
+  void cullCpu(const FrustumPlanes &planes);
+  void cullGpu(const FrustumPlanes &planes);
+
+  CullingMode culling_;
+  float lod_screen_size_;
+  Shader cull_shader_;
+  std::vector<InstanceData> instances_{};
+  // Current LOD per entity index
+  std::vector<uint8_t> entity_lods_{};
+  // LOD of each packet item and the items in batch order
+  std::vector<uint32_t> item_lods_{};
+  std::vector<uint32_t> item_order_{};
+  std::array<uint32_t, MAX_MESH_LODS> lod_counts_{};
+  std::vector<Batch> batches_{};
+  std::vector<CullItem> cull_items_{};
+  std::vector<DrawCommand> commands_{};
+  std::vector<uint32_t> visible_{};
+  PackedSpheres spheres_{};
+  std::vector<uint8_t> visibility_{};
+  uint32_t visible_count_{0};
+  uint32_t draw_count_{0};
+  gl::buffer instance_buffer_{};
+  gl::buffer visible_buffer_{};
+  gl::buffer cull_buffer_{};
+  gl::buffer command_buffer_{};
+};
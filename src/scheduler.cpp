@@ -0,0 +1,119 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+
+bool intersects(const std::vector<entt::id_type> &a,
+                const std::vector<entt::id_type> &b) {
+  return std::any_of(a.begin(), a.end(), [&](entt::id_type id) {
+    return std::find(b.begin(), b.end(), id) != b.end();
+  });
+}
+
+} // namespace
+
+bool SystemAccess::conflicts(const SystemAccess &other) const {
+  if (exclusive_ || other.exclusive_) {
+    return true;
+  }
+  return intersects(writes_, other.writes_) ||
+         intersects(writes_, other.reads_) ||
+         intersects(reads_, other.writes_);
+}
+
+Scheduler::Scheduler(ThreadPool &pool, std::unique_ptr<Clock> clock,
+                     Clock::Duration step, uint32_t max_steps)
+    : pool_(pool), clock_(std::move(clock)), step_(step),
+      max_steps_(max_steps), waves_(3) {}
+
+void Scheduler::add(Stage stage, std::string name, SystemAccess access,
+                    System system) {
+  uint32_t wave = 0;
+  for (const auto &entry : systems_) {
+    if (entry.stage == stage && entry.access.conflicts(access)) {
+      wave = std::max(wave, entry.wave + 1);
+    }
+  }
+
+  auto &stage_waves = waves_[std::size_t(stage)];
+  if (stage_waves.size() <= wave) {
+    stage_waves.resize(wave + 1);
+  }
+  stage_waves[wave].push_back(systems_.size());
+  systems_.push_back({stage, std::move(name), std::move(access),
+                      std::move(system), wave, 0.0});
+}
+
+void Scheduler::update(World &world, Profiler &profiler) {
+  auto &time = world.ctx().at<Time>();
+  const double step_seconds = std::chrono::duration<double>(step_).count();
+  time.dt = float(step_seconds);
+
+  for (auto &entry : systems_) {
+    entry.cpu_ms = 0.0;
+  }
+
+  accumulator_ += clock_->advance();
+  run(Stage::Input, world);
+
+  step_count_ = 0;
+  while (accumulator_ >= step_ && step_count_ < max_steps_) {
+    accumulator_ -= step_;
+    ++time.steps;
+    time.elapsed = double(time.steps) * step_seconds;
+    run(Stage::Fixed, world);
+    ++step_count_;
+  }
+  if (accumulator_ >= step_) {
+    accumulator_ = Clock::Duration::zero();
+  }
+
+  time.alpha = float(std::chrono::duration<double>(accumulator_).count() /
+                     step_seconds);
+  run(Stage::Render, world);
+
+  for (const auto &entry : systems_) {
+    profiler.setSystemTime(entry.name.c_str(), entry.cpu_ms);
+  }
+  profiler.setCounter("simulation_steps", step_count_);
+}
+
+Clock::Duration Scheduler::getStep() const { return step_; }
+
+uint32_t Scheduler::getStepCount() const { return step_count_; }
+
+std::size_t Scheduler::getMaxWaveSize() const {
+  std::size_t size = 0;
+  for (const auto &stage_waves : waves_) {
+    for (const auto &wave : stage_waves) {
+      size = std::max(size, wave.size());
+    }
+  }
+  return size;
+}
+
+void Scheduler::run(Stage stage, World &world) {
+  for (const auto &wave : waves_[std::size_t(stage)]) {
+    if (wave.size() == 1) {
+      runEntry(systems_[wave.front()], world);
+      continue;
+    }
+    pool_.parallelFor(wave.size(), 1, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        runEntry(systems_[wave[i]], world);
+      }
+    });
+  }
+}
+
+void Scheduler::runEntry(Entry &entry, World &world) {
+  using SteadyClock = std::chrono::steady_clock;
+  const auto start = SteadyClock::now();
+  entry.system(world);
+  entry.cpu_ms +=
+      std::chrono::duration<double, std::milli>(SteadyClock::now() - start)
+          .count();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "clock.h"
+#include "components.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+#include <entt/entt.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class Stage {
+  // Once per frame before the fixed steps, e.g. consuming per-frame input
+  Input,
+  // Zero or more times per frame, each advancing the simulation by one step
+  Fixed,
+  // Once per frame after the fixed steps, with Time::alpha set
+  Render,
+};
+
+// Components and context variables a system reads and writes. Systems whose
+// accesses do not conflict may run at the same time. Note that patching a
+// Transform also writes TransformDirty. A system without declared access
+// is exclusive.
+class SystemAccess {
+public:
+  template <typename... T> SystemAccess &read() {
+    (reads_.push_back(entt::type_hash<T>::value()), ...);
+    exclusive_ = false;
+    return *this;
+  }
+
+  template <typename... T> SystemAccess &write() {
+    (writes_.push_back(entt::type_hash<T>::value()), ...);
+    exclusive_ = false;
+    return *this;
+  }
+
+  bool conflicts(const SystemAccess &other) const;
+
+private:
+  std::vector<entt::id_type> reads_{};
+  std::vector<entt::id_type> writes_{};
+  bool exclusive_{true};
+};
+
+// Runs the systems of a World with a fixed simulation step. Frame time from
+// the clock is accumulated and consumed in whole steps, the remainder is
+// exposed as Time::alpha so render state can be interpolated between the
+// last two steps. Every system's CPU time is summed over the frame and
+// recorded with the profiler.
+//
+// Systems of a stage are grouped into waves: a system goes into the first
+// wave after every earlier system it conflicts with, so the order between
+// conflicting systems is the order they were added in. The systems of a
+// wave run in parallel on the thread pool. Systems must not call GL.
+class Scheduler {
+public:
+  using System = std::function<void(World &)>;
+
+  // At most max_steps are run per frame, time beyond that is dropped so a
+  // slow frame does not make the next one slower.
+  Scheduler(ThreadPool &pool, std::unique_ptr<Clock> clock,
+            Clock::Duration step, uint32_t max_steps = 8);
+
+  void add(Stage stage, std::string name, SystemAccess access, System system);
+
+  // Advances the clock, runs every stage and updates the Time context.
+  void update(World &world, Profiler &profiler);
+
+  Clock::Duration getStep() const;
+  // Steps run by the last update().
+  uint32_t getStepCount() const;
+  // Largest number of systems that can run at the same time in any stage.
+  std::size_t getMaxWaveSize() const;
+
+private:
+  struct Entry {
+    Stage stage;
+    std::string name;
+    SystemAccess access;
+    System system;
+    uint32_t wave;
+    double cpu_ms;
+  };
+
+  void run(Stage stage, World &world);
+  void runEntry(Entry &entry, World &world);
+
+  ThreadPool &pool_;
+  std::unique_ptr<Clock> clock_;
+  Clock::Duration step_;
+  uint32_t max_steps_;
+  Clock::Duration accumulator_{0};
+  uint32_t step_count_{0};
+  std::vector<Entry> systems_{};
+  // Indices into systems_ per stage and wave
+  std::vector<std::vector<std::vector<std::size_t>>> waves_{};
+};
+
+// Calls fn(entity) for every entity of the view in chunks on the pool. fn
+// may only modify components of that entity in place: no structural changes
+// and no patch(), whose listeners are not thread safe. Mark changed
+// components afterwards with markUpdated().
+template <typename View, typename Fn>
+void parallelEach(ThreadPool &pool, const View &view, Fn &&fn,
+                  std::size_t chunk_size = 256) {
+  const std::vector<entt::entity> entities(view.begin(), view.end());
+  pool.parallelFor(entities.size(), chunk_size,
+                   [&](std::size_t begin, std::size_t end) {
+                     for (std::size_t i = begin; i < end; ++i) {
+                       fn(entities[i]);
+                     }
+                   });
+}
+
+// Triggers the on_update listeners of T for every entity of the view, e.g.
+// after parallelEach() modified it in place.
+template <typename T, typename... Other> void markUpdated(World &world) {
+  for (auto entity : world.view<T, Other...>()) {
+    world.patch<T>(entity);
+  }
+}
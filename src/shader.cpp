@@ -1,14 +1,134 @@
 #include "shader.h"
+#include "state_cache.h"
 
-Shader::Shader(gl::program &&program) : program{std::move(program)} {}
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 
-void Shader::use() const { program.use(); }
+namespace {
 
-int Shader::getLocation(const char *name) {
-  if (auto it = uniforms.find(name); it != uniforms.end()) {
-    return it->second;
+constexpr int UNRESOLVED_LOCATION = -2;
+
+} // namespace
+
+uint32_t allocateUniformSlot() {
+  static std::atomic<uint32_t> next_slot{0};
+  return next_slot++;
+}
+
+Shader::Shader(std::shared_ptr<ProgramHandle> handle)
+    : handle{std::move(handle)}, generation{this->handle->generation} {}
+
+void Shader::use() {
+  sync();
+  StateCache::get().useProgram(handle->program.id());
+}
+
+void Shader::sync() {
+  if (generation == handle->generation) {
+    return;
+  }
+  generation = handle->generation;
+  std::fill(locations.begin(), locations.end(), UNRESOLVED_LOCATION);
+  for (uint32_t slot = 0; slot < uniforms.size(); ++slot) {
+    if (!uniforms[slot].name) {
+      continue;
+    }
+    const int location = getLocation(slot, uniforms[slot].name);
+    std::visit(
+        [&](const auto &value) {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, std::vector<glm::vec2>> ||
+                        std::is_same_v<T, std::vector<glm::vec4>>) {
+            setValue(location, std::span(value.data(), value.size()));
+          } else {
+            setValue(location, value);
+          }
+        },
+        uniforms[slot].value);
+  }
+}
+
+Shader::StoredUniform &Shader::getStored(uint32_t slot, const char *name) {
+  if (slot >= uniforms.size()) {
+    uniforms.resize(slot + 1);
+  }
+  uniforms[slot].name = name;
+  return uniforms[slot];
+}
+
+int Shader::getLocation(uint32_t slot, const char *name) {
+  if (slot >= locations.size()) {
+    locations.resize(slot + 1, UNRESOLVED_LOCATION);
+  }
+  if (locations[slot] == UNRESOLVED_LOCATION) {
+    locations[slot] = handle->program.uniform_location(name);
+    if (locations[slot] < 0) {
+      std::cerr << "Bad uniform location: " << name << '\n';
+    }
+  }
+  return locations[slot];
+}
+
+void Shader::setValue(int location, int value) {
+  glProgramUniform1i(handle->program.id(), location, value);
+}
+
+void Shader::setValue(int location, float value) {
+  glProgramUniform1f(handle->program.id(), location, value);
+}
+
+void Shader::setValue(int location, const glm::ivec2 &value) {
+  glProgramUniform2iv(handle->program.id(), location, 1, &value.x);
+}
+
+void Shader::setValue(int location, const glm::vec2 &value) {
+  glProgramUniform2fv(handle->program.id(), location, 1, &value.x);
+}
+
+void Shader::setValue(int location, const glm::vec3 &value) {
+  glProgramUniform3fv(handle->program.id(), location, 1, &value.x);
+}
+
+void Shader::setValue(int location, const glm::vec4 &value) {
+  glProgramUniform4fv(handle->program.id(), location, 1, &value.x);
+}
+
+void Shader::setValue(int location, const glm::mat4 &value) {
+  glProgramUniformMatrix4fv(handle->program.id(), location, 1, GL_FALSE,
+                            &value[0][0]);
+}
+
+void Shader::setValue(int location, std::span<const glm::vec2> values) {
+  glProgramUniform2fv(handle->program.id(), location,
+                      GLsizei(values.size()), &values.data()->x);
+}
+
+void Shader::setValue(int location, std::span<const glm::vec4> values) {
+  glProgramUniform4fv(handle->program.id(), location,
+                      GLsizei(values.size()), &values.data()->x);
+}
+
+std::string loadShaderSource(const char *path,
+                             const std::vector<std::string> &defines) {
+  std::ifstream file(path);
+  std::string source((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+  if (defines.empty()) {
+    return source;
+  }
+
+  std::string define_block;
+  for (const auto &define : defines) {
+    define_block += "#define " + define + '\n';
+  }
+  std::size_t insert_at = 0;
+  if (source.compare(0, 8, "#version") == 0) {
+    insert_at = source.find('\n');
+    insert_at = insert_at == std::string::npos ? source.size() : insert_at + 1;
   }
-  const auto location = program.uniform_location(name);
-  uniforms[name] = location;
-  return location;
-}
\ No newline at end of file
+  source.insert(insert_at, define_block);
+  return source;
+}
@@ -1,26 +1,114 @@
 #pragma once
 
-#include <gl/auxiliary/glm_uniforms.hpp>
 #include <gl/program.hpp>
+#include <glm/glm.hpp>
 
-#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// String literal usable as a template argument.
+template <std::size_t N> struct FixedString {
+  char value[N]{};
+
+  constexpr FixedString(const char (&string)[N]) {
+    std::copy_n(string, N, value);
+  }
+};
+
+uint32_t allocateUniformSlot();
+
+// Compile-time key of a uniform with its GLSL name and C++ type. Every key
+// gets a process wide slot index the first time it is used, and shaders
+// cache the location of each slot, so setting a uniform is an array lookup.
+template <class T, FixedString Name> struct Uniform {
+  static constexpr const char *name() { return Name.value; }
+
+  static uint32_t slot() {
+    static const uint32_t index = allocateUniformSlot();
+    return index;
+  }
+};
+
+// Linked program shared by every Shader built from the same sources.
+// ProgramRegistry replaces `program` and bumps `generation` when the
+// sources are reloaded.
+struct ProgramHandle {
+  gl::program program;
+  uint32_t generation{0};
+};
 
 class Shader {
 public:
-  explicit Shader(gl::program &&program);
+  explicit Shader(std::shared_ptr<ProgramHandle> handle);
 
-  template <class T> void setUniform(const char *name, const T &value) {
-    const auto location = getLocation(name);
-    if (location < 0) {
-      std::cerr << "Bad uniform location: " << name << '\n';
-    }
-    program.set_uniform(location, value);
+  template <class T, FixedString Name>
+  void set(Uniform<T, Name>, const std::type_identity_t<T> &value) {
+    const uint32_t slot = Uniform<T, Name>::slot();
+    sync();
+    store(slot, Name.value, value);
+    setValue(getLocation(slot, Name.value), value);
   }
 
-  void use() const;
-  int getLocation(const char *name);
+  void use();
 
 private:
-  gl::program program;
-  std::unordered_map<std::string, int> uniforms{};
+  using UniformValue =
+      std::variant<int, float, glm::ivec2, glm::vec2, glm::vec3, glm::vec4,
+                   glm::mat4, std::vector<glm::vec2>, std::vector<glm::vec4>>;
+
+  // Last value set through a slot, set again on a reloaded program
+  struct StoredUniform {
+    const char *name{nullptr};
+    UniformValue value{};
+  };
+
+  // Drops the cached locations and restores the uniforms once the program
+  // has been reloaded.
+  void sync();
+  StoredUniform &getStored(uint32_t slot, const char *name);
+
+  template <class T>
+  void store(uint32_t slot, const char *name, const T &value) {
+    getStored(slot, name).value = value;
+  }
+
+  // Arrays reuse the storage of the previous value, they are set per frame.
+  template <class T>
+  void store(uint32_t slot, const char *name, std::span<const T> values) {
+    auto &stored = getStored(slot, name).value;
+    if (auto *vector = std::get_if<std::vector<T>>(&stored)) {
+      vector->assign(values.begin(), values.end());
+    } else {
+      stored = std::vector<T>(values.begin(), values.end());
+    }
+  }
+
+  int getLocation(uint32_t slot, const char *name);
+
+  void setValue(int location, int value);
+  void setValue(int location, float value);
+  void setValue(int location, const glm::ivec2 &value);
+  void setValue(int location, const glm::vec2 &value);
+  void setValue(int location, const glm::vec3 &value);
+  void setValue(int location, const glm::vec4 &value);
+  void setValue(int location, const glm::mat4 &value);
+  void setValue(int location, std::span<const glm::vec2> values);
+  void setValue(int location, std::span<const glm::vec4> values);
+
+  std::shared_ptr<ProgramHandle> handle;
+  uint32_t generation{0};
+  std::vector<int> locations{};
+  std::vector<StoredUniform> uniforms{};
 };
+
+// Reads a GLSL file and inserts a `#define` for every entry in `defines`
+// right after its #version line.
+std::string loadShaderSource(const char *path,
+                             const std::vector<std::string> &defines);
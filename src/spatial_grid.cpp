@@ -0,0 +1,109 @@
+#include "spatial_grid.h"
+
+#include <cmath>
+
+namespace {
+
+// Cell coordinates are packed into 21 bits each.
+constexpr int CELL_BITS = 21;
+constexpr int CELL_OFFSET = 1 << (CELL_BITS - 1);
+constexpr uint64_t CELL_MASK = (uint64_t(1) << CELL_BITS) - 1;
+
+std::size_t entityIndex(entt::entity entity) {
+  return std::size_t(entt::to_entity(entity));
+}
+
+} // namespace
+
+SpatialGrid::SpatialGrid(float cell_size)
+    : cell_size_{cell_size}, inverse_cell_size_{1.0f / cell_size} {}
+
+void SpatialGrid::update(entt::entity entity, const glm::vec3 &position) {
+  const std::size_t index = entityIndex(entity);
+  if (index >= locations_.size() || locations_[index].slot == NO_SLOT) {
+    insert(entity, position);
+    return;
+  }
+  const uint64_t cell = cellKey(cellOf(position));
+  const Location location = locations_[index];
+  if (location.cell == cell) {
+    cells_[cell][location.slot].position = position;
+    return;
+  }
+  remove(entity);
+  insert(entity, position);
+}
+
+void SpatialGrid::remove(entt::entity entity) {
+  if (!contains(entity)) {
+    return;
+  }
+  auto &location = locations_[entityIndex(entity)];
+  auto it = cells_.find(location.cell);
+  auto &items = it->second;
+  // Swap with the last item of the cell and fix up its slot.
+  items[location.slot] = items.back();
+  locations_[entityIndex(items[location.slot].entity)].slot = location.slot;
+  items.pop_back();
+  if (items.empty()) {
+    cells_.erase(it);
+  }
+  location.slot = NO_SLOT;
+  --size_;
+}
+
+bool SpatialGrid::contains(entt::entity entity) const {
+  const std::size_t index = entityIndex(entity);
+  return index < locations_.size() && locations_[index].slot != NO_SLOT;
+}
+
+void SpatialGrid::query(const glm::vec3 &center, float radius,
+                        std::vector<entt::entity> &out) const {
+  const glm::ivec3 first = cellOf(center - glm::vec3(radius));
+  const glm::ivec3 last = cellOf(center + glm::vec3(radius));
+  const float radius2 = radius * radius;
+  for (int z = first.z; z <= last.z; ++z) {
+    for (int y = first.y; y <= last.y; ++y) {
+      for (int x = first.x; x <= last.x; ++x) {
+        const auto it = cells_.find(cellKey({x, y, z}));
+        if (it == cells_.end()) {
+          continue;
+        }
+        for (const auto &item : it->second) {
+          const glm::vec3 offset = item.position - center;
+          if (glm::dot(offset, offset) <= radius2) {
+            out.push_back(item.entity);
+          }
+        }
+      }
+    }
+  }
+}
+
+std::size_t SpatialGrid::size() const { return size_; }
+
+float SpatialGrid::getCellSize() const { return cell_size_; }
+
+glm::ivec3 SpatialGrid::cellOf(const glm::vec3 &position) const {
+  return glm::ivec3(glm::floor(position * inverse_cell_size_));
+}
+
+uint64_t SpatialGrid::cellKey(const glm::ivec3 &cell) {
+  const auto pack = [](int v) {
+    return uint64_t(uint32_t(v + CELL_OFFSET)) & CELL_MASK;
+  };
+  return pack(cell.x) | (pack(cell.y) << CELL_BITS) |
+         (pack(cell.z) << (2 * CELL_BITS));
+}
+
+void SpatialGrid::insert(entt::entity entity, const glm::vec3 &position) {
+  const std::size_t index = entityIndex(entity);
+  if (index >= locations_.size()) {
+    locations_.resize(index + 1, {0, NO_SLOT});
+  }
+  const uint64_t cell = cellKey(cellOf(position));
+  auto &items = cells_[cell];
+  locations_[index] = {cell, uint32_t(items.size())};
+  items.push_back({entity, position});
+  ++size_;
+}
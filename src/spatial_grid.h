@@ -0,0 +1,53 @@
+#pragma once
+
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Uniform hash grid of entity positions. Cells are only allocated where
+// entities are, and every entity remembers its cell and slot so moves and
+// removals are O(1).
+class SpatialGrid {
+public:
+  explicit SpatialGrid(float cell_size);
+
+  // Inserts the entity or moves it to `position`.
+  void update(entt::entity entity, const glm::vec3 &position);
+  void remove(entt::entity entity);
+  bool contains(entt::entity entity) const;
+
+  // Appends every entity within `radius` of `center` to `out`.
+  void query(const glm::vec3 &center, float radius,
+             std::vector<entt::entity> &out) const;
+
+  std::size_t size() const;
+  float getCellSize() const;
+
+private:
+  struct Item {
+    entt::entity entity;
+    glm::vec3 position;
+  };
+
+  struct Location {
+    uint64_t cell;
+    uint32_t slot;
+  };
+
+  static constexpr uint32_t NO_SLOT = ~0u;
+
+  glm::ivec3 cellOf(const glm::vec3 &position) const;
+  static uint64_t cellKey(const glm::ivec3 &cell);
+  void insert(entt::entity entity, const glm::vec3 &position);
+
+  float cell_size_;
+  float inverse_cell_size_;
+  std::unordered_map<uint64_t, std::vector<Item>> cells_{};
+  // Indexed by entity index
+  std::vector<Location> locations_{};
+  std::size_t size_{0};
+};
@@ -0,0 +1,79 @@
+#include "staging_buffer.h"
+
+namespace {
+
+constexpr std::size_t STAGING_ALIGNMENT = 16;
+constexpr GLbitfield STAGING_FLAGS =
+    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+} // namespace
+
+StagingBuffer::StagingBuffer(std::size_t size) : size_{size} {
+  glNamedBufferStorage(buffer_.id(), GLsizeiptr(size_), nullptr,
+                       STAGING_FLAGS);
+  mapped_ = static_cast<std::byte *>(
+      glMapNamedBufferRange(buffer_.id(), 0, GLsizeiptr(size_), STAGING_FLAGS));
+}
+
+StagingBuffer::~StagingBuffer() {
+  for (const auto &fence : fences_) {
+    glDeleteSync(fence.sync);
+  }
+  if (mapped_) {
+    glUnmapNamedBuffer(buffer_.id());
+  }
+}
+
+std::optional<std::size_t> StagingBuffer::allocate(std::size_t size) {
+  retire();
+
+  if (used_ == 0) {
+    head_ = 0;
+  }
+
+  size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+  std::size_t offset = head_;
+  std::size_t needed = size;
+  if (offset + size > size_) {
+    // The tail end of the ring is skipped and accounted as used.
+    needed += size_ - offset;
+    offset = 0;
+  }
+  if (!mapped_ || size > size_ || used_ + needed > size_) {
+    return std::nullopt;
+  }
+
+  head_ = (offset + size) % size_;
+  used_ += needed;
+  frame_bytes_ += needed;
+  return offset;
+}
+
+void *StagingBuffer::getPointer(std::size_t offset) const {
+  return mapped_ + offset;
+}
+
+const gl::buffer &StagingBuffer::getBuffer() const { return buffer_; }
+
+std::size_t StagingBuffer::getSize() const { return size_; }
+
+void StagingBuffer::endFrame() {
+  if (frame_bytes_ == 0) {
+    return;
+  }
+  fences_.push_back(
+      {glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame_bytes_});
+  frame_bytes_ = 0;
+}
+
+void StagingBuffer::retire() {
+  while (!fences_.empty()) {
+    const auto status = glClientWaitSync(fences_.front().sync, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(fences_.front().sync);
+    used_ -= fences_.front().bytes;
+    fences_.pop_front();
+  }
+}
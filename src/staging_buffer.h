@@ -0,0 +1,42 @@
+#pragma once
+
+#include <gl/all.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <optional>
+
+// Persistently mapped ring buffer for CPU -> GPU uploads. Space written in
+// one frame is reused once the fence placed by endFrame() has signaled.
+class StagingBuffer {
+public:
+  explicit StagingBuffer(std::size_t size);
+  ~StagingBuffer();
+
+  StagingBuffer(const StagingBuffer &) = delete;
+  StagingBuffer &operator=(const StagingBuffer &) = delete;
+
+  // Returns the offset of `size` free bytes or nullopt when the ring is full.
+  std::optional<std::size_t> allocate(std::size_t size);
+  void *getPointer(std::size_t offset) const;
+  const gl::buffer &getBuffer() const;
+  std::size_t getSize() const;
+
+  void endFrame();
+
+private:
+  struct Fence {
+    GLsync sync;
+    std::size_t bytes;
+  };
+
+  void retire();
+
+  gl::buffer buffer_{};
+  std::byte *mapped_{nullptr};
+  std::size_t size_;
+  std::size_t head_{0};
+  std::size_t used_{0};
+  std::size_t frame_bytes_{0};
+  std::deque<Fence> fences_{};
+};
@@ -0,0 +1,52 @@
+#include "state_cache.h"
+
+StateCache &StateCache::get() {
+  static StateCache cache;
+  return cache;
+}
+
+void StateCache::useProgram(GLuint program) {
+  if (update(program_, program)) {
+    glUseProgram(program);
+  }
+}
+
+void StateCache::bindVertexArray(GLuint vertex_array) {
+  if (update(vertex_array_, vertex_array)) {
+    glBindVertexArray(vertex_array);
+  }
+}
+
+void StateCache::bindTextureUnit(GLuint unit, GLuint texture) {
+  if (unit >= CACHED_TEXTURE_UNITS) {
+    ++issued_;
+    glBindTextureUnit(unit, texture);
+    return;
+  }
+  if (update(textures_[unit], texture)) {
+    glBindTextureUnit(unit, texture);
+  }
+}
+
+void StateCache::setStencilFunction(GLenum function, GLint reference,
+                                    GLuint mask) {
+  if (update(stencil_function_, StencilFunction{function, reference, mask})) {
+    glStencilFunc(function, reference, mask);
+  }
+}
+
+void StateCache::invalidate() {
+  program_.reset();
+  vertex_array_.reset();
+  textures_.fill(std::nullopt);
+  stencil_function_.reset();
+}
+
+uint32_t StateCache::getIssuedCount() const { return issued_; }
+
+uint32_t StateCache::getSkippedCount() const { return skipped_; }
+
+void StateCache::resetCounters() {
+  issued_ = 0;
+  skipped_ = 0;
+}
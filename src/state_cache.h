@@ -0,0 +1,57 @@
+#pragma once
+
+#include <gl/all.hpp>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// Mirrors the GL state that changes most often during a frame and drops
+// calls that would not change it. Everything that binds programs, vertex
+// arrays, texture units or sets the stencil function has to go through
+// here, or call invalidate() afterwards. The same applies when a bound
+// object is deleted, since GL may hand its name out again.
+class StateCache {
+public:
+  static StateCache &get();
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vertex_array);
+  void bindTextureUnit(GLuint unit, GLuint texture);
+  void setStencilFunction(GLenum function, GLint reference, GLuint mask);
+  void invalidate();
+
+  // Calls forwarded to GL and calls dropped since the last resetCounters()
+  uint32_t getIssuedCount() const;
+  uint32_t getSkippedCount() const;
+  void resetCounters();
+
+private:
+  static constexpr GLuint CACHED_TEXTURE_UNITS = 16;
+
+  struct StencilFunction {
+    GLenum function;
+    GLint reference;
+    GLuint mask;
+
+    bool operator==(const StencilFunction &) const = default;
+  };
+
+  // Counts the call and returns whether it has to be issued.
+  template <class T> bool update(std::optional<T> &cached, const T &value) {
+    if (cached == value) {
+      ++skipped_;
+      return false;
+    }
+    cached = value;
+    ++issued_;
+    return true;
+  }
+
+  std::optional<GLuint> program_{};
+  std::optional<GLuint> vertex_array_{};
+  std::array<std::optional<GLuint>, CACHED_TEXTURE_UNITS> textures_{};
+  std::optional<StencilFunction> stencil_function_{};
+  uint32_t issued_{0};
+  uint32_t skipped_{0};
+};
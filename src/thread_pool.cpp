@@ -0,0 +1,155 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Pool and queue index of the current worker thread
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+
+struct ParallelFor {
+  const std::function<void(std::size_t, std::size_t)> *fn;
+  std::size_t count;
+  std::size_t chunk_size;
+  std::size_t chunk_count;
+  std::atomic<std::size_t> next{0};
+  std::atomic<std::size_t> done{0};
+
+  // Runs chunks until none are left. fn is only touched for a claimed chunk,
+  // the caller is still waiting for that one, so it stays valid.
+  void work() {
+    for (std::size_t chunk = next.fetch_add(1); chunk < chunk_count;
+         chunk = next.fetch_add(1)) {
+      const std::size_t begin = chunk * chunk_size;
+      (*fn)(begin, std::min(begin + chunk_size, count));
+      if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == chunk_count) {
+        done.notify_all();
+      }
+    }
+  }
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t thread_count) {
+  if (thread_count == 0) {
+    const std::size_t hardware = std::thread::hardware_concurrency();
+    thread_count = std::max<std::size_t>(hardware, 2) - 1;
+  }
+  queues_.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  threads_.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; ++i) {
+    threads_.emplace_back([this, i] { run(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  const std::size_t index =
+      current_pool == this
+          ? current_index
+          : next_queue_.fetch_add(1, std::memory_order_relaxed) %
+                queues_.size();
+  {
+    std::lock_guard lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+    queued_.fetch_add(1);
+  }
+  {
+    // Orders the increment with a worker checking it before going to sleep.
+    std::lock_guard lock(mutex_);
+  }
+  condition_.notify_one();
+}
+
+void ThreadPool::parallelFor(
+    std::size_t count, std::size_t chunk_size,
+    const std::function<void(std::size_t, std::size_t)> &fn) {
+  if (count == 0) {
+    return;
+  }
+  chunk_size = std::max<std::size_t>(chunk_size, 1);
+  const std::size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+  if (chunk_count == 1) {
+    fn(0, count);
+    return;
+  }
+
+  // Workers that start after the last chunk was claimed still hold the
+  // state, so it is shared rather than on the stack.
+  auto state = std::make_shared<ParallelFor>();
+  state->fn = &fn;
+  state->count = count;
+  state->chunk_size = chunk_size;
+  state->chunk_count = chunk_count;
+
+  const std::size_t helpers = std::min(threads_.size(), chunk_count - 1);
+  for (std::size_t i = 0; i < helpers; ++i) {
+    submit([state] { state->work(); });
+  }
+  state->work();
+
+  for (std::size_t done = state->done.load(std::memory_order_acquire);
+       done != chunk_count;
+       done = state->done.load(std::memory_order_acquire)) {
+    state->done.wait(done);
+  }
+}
+
+std::size_t ThreadPool::getThreadCount() const { return threads_.size(); }
+
+void ThreadPool::run(std::size_t index) {
+  current_pool = this;
+  current_index = index;
+  while (true) {
+    std::function<void()> task;
+    if (tryPop(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock lock(mutex_);
+    condition_.wait(lock, [this] { return stopping_ || queued_.load() != 0; });
+    // Queued tasks are still executed when the pool is shutting down.
+    if (stopping_ && queued_.load() == 0) {
+      return;
+    }
+  }
+}
+
+bool ThreadPool::tryPop(std::size_t index, std::function<void()> &task) {
+  {
+    auto &own = *queues_[index];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < queues_.size(); ++i) {
+    auto &victim = *queues_[(index + i) % queues_.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
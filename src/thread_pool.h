@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Every worker owns a task queue. Tasks submitted from a worker go to its
+// own queue and are run newest first, idle workers steal the oldest task of
+// another queue. Tasks submitted from other threads are spread round robin.
+class ThreadPool {
+public:
+  // 0 picks one thread less than the number of hardware threads.
+  explicit ThreadPool(std::size_t thread_count = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+
+  // Calls fn(begin, end) for every chunk of [0, count) and returns once all
+  // chunks are done. Chunks are claimed by the calling thread and idle
+  // workers. The calling thread only runs chunks of this call, so it is
+  // never held up by an unrelated long task such as an asset load.
+  void parallelFor(std::size_t count, std::size_t chunk_size,
+                   const std::function<void(std::size_t, std::size_t)> &fn);
+
+  std::size_t getThreadCount() const;
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(std::size_t index);
+  bool tryPop(std::size_t index, std::function<void()> &task);
+
+  std::vector<std::thread> threads_{};
+  std::vector<std::unique_ptr<Queue>> queues_{};
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> next_queue_{0};
+  std::mutex mutex_{};
+  std::condition_variable condition_{};
+  bool stopping_{false};
+};
@@ -0,0 +1,176 @@
+#include "transform_system.h"
+
+#include <cmath>
+
+namespace {
+
+// Matrices composed per task, small enough to spread a few thousand dirty
+// transforms over the workers.
+constexpr std::size_t COMPOSE_CHUNK_SIZE = 512;
+
+void markTransformDirty(World &world, entt::entity entity) {
+  world.emplace_or_replace<TransformDirty>(entity);
+}
+
+void createWorldMatrix(World &world, entt::entity entity) {
+  world.emplace_or_replace<WorldMatrix>(entity);
+  world.emplace_or_replace<TransformDirty>(entity);
+}
+
+void destroyWorldMatrix(World &world, entt::entity entity) {
+  world.remove<WorldMatrix, TransformDirty>(entity);
+}
+
+// Moved entities are drawn at the render time like the camera instead of
+// jumping from step to step.
+void createInterpolated(World &world, entt::entity entity) {
+  Interpolated state;
+  if (const auto *transform = world.try_get<const Transform>(entity)) {
+    state.previous_translation = transform->translation;
+  }
+  world.emplace_or_replace<Interpolated>(entity, state);
+}
+
+struct TransformCache {
+  std::vector<entt::entity> entities;
+  PackedTransforms transforms;
+  std::vector<glm::mat4> matrices;
+};
+
+} // namespace
+
+void PackedTransforms::clear() {
+  for (auto *v : {&tx, &ty, &tz, &rx, &ry, &rz, &sx, &sy, &sz}) {
+    v->clear();
+  }
+}
+
+void PackedTransforms::push(const Transform &transform) {
+  tx.push_back(transform.translation.x);
+  ty.push_back(transform.translation.y);
+  tz.push_back(transform.translation.z);
+  rx.push_back(transform.rotation.x);
+  ry.push_back(transform.rotation.y);
+  rz.push_back(transform.rotation.z);
+  sx.push_back(transform.scale.x);
+  sy.push_back(transform.scale.y);
+  sz.push_back(transform.scale.z);
+}
+
+std::size_t PackedTransforms::size() const { return tx.size(); }
+
+void composeWorldMatrices(const PackedTransforms &transforms,
+                          std::size_t begin, std::size_t end,
+                          glm::mat4 *out) {
+  const float *tx = transforms.tx.data();
+  const float *ty = transforms.ty.data();
+  const float *tz = transforms.tz.data();
+  const float *rx = transforms.rx.data();
+  const float *ry = transforms.ry.data();
+  const float *rz = transforms.rz.data();
+  const float *sx = transforms.sx.data();
+  const float *sy = transforms.sy.data();
+  const float *sz = transforms.sz.data();
+  float *m = &out[0][0][0];
+
+  for (std::size_t i = begin; i < end; ++i) {
+    // glm::quat(euler) followed by glm::toMat4, without the temporaries.
+    const float cx = std::cos(rx[i] * 0.5f), sxh = std::sin(rx[i] * 0.5f);
+    const float cy = std::cos(ry[i] * 0.5f), syh = std::sin(ry[i] * 0.5f);
+    const float cz = std::cos(rz[i] * 0.5f), szh = std::sin(rz[i] * 0.5f);
+
+    const float qw = cx * cy * cz + sxh * syh * szh;
+    const float qx = sxh * cy * cz - cx * syh * szh;
+    const float qy = cx * syh * cz + sxh * cy * szh;
+    const float qz = cx * cy * szh - sxh * syh * cz;
+
+    const float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+    const float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+    const float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+    float *col = m + i * 16;
+    col[0] = (1.0f - 2.0f * (yy + zz)) * sx[i];
+    col[1] = 2.0f * (xy + wz) * sx[i];
+    col[2] = 2.0f * (xz - wy) * sx[i];
+    col[3] = 0.0f;
+    col[4] = 2.0f * (xy - wz) * sy[i];
+    col[5] = (1.0f - 2.0f * (xx + zz)) * sy[i];
+    col[6] = 2.0f * (yz + wx) * sy[i];
+    col[7] = 0.0f;
+    col[8] = 2.0f * (xz + wy) * sz[i];
+    col[9] = 2.0f * (yz - wx) * sz[i];
+    col[10] = (1.0f - 2.0f * (xx + yy)) * sz[i];
+    col[11] = 0.0f;
+    col[12] = tx[i];
+    col[13] = ty[i];
+    col[14] = tz[i];
+    col[15] = 1.0f;
+  }
+}
+
+void registerTransformTracking(World &world) {
+  world.ctx().emplace<TransformCache>();
+  world.on_construct<Transform>().connect<&createWorldMatrix>();
+  world.on_update<Transform>().connect<&markTransformDirty>();
+  world.on_destroy<Transform>().connect<&destroyWorldMatrix>();
+  world.on_construct<Move>().connect<&createInterpolated>();
+}
+
+void updateWorldMatrices(World &world, float alpha, ThreadPool *pool) {
+  auto &cache = world.ctx().at<TransformCache>();
+  cache.entities.clear();
+  cache.transforms.clear();
+
+  // Interpolated entities in motion change every frame with alpha, and once
+  // more when they stop to land on their final translation.
+  for (auto [entity, transform, state] :
+       world.view<const Transform, Interpolated>().each()) {
+    const bool moving = transform.translation != state.previous_translation;
+    if (moving || state.moving) {
+      world.emplace_or_replace<TransformDirty>(entity);
+    }
+    state.moving = moving;
+  }
+
+  auto dirty = world.view<const Transform, TransformDirty>();
+  for (auto entity : dirty) {
+    cache.entities.push_back(entity);
+    const auto &transform = dirty.get<const Transform>(entity);
+    if (const auto *state = world.try_get<const Interpolated>(entity)) {
+      Transform blended = transform;
+      blended.translation =
+          glm::mix(state->previous_translation, transform.translation, alpha);
+      cache.transforms.push(blended);
+    } else {
+      cache.transforms.push(transform);
+    }
+  }
+  if (cache.entities.empty()) {
+    return;
+  }
+
+  cache.matrices.resize(cache.entities.size());
+  if (pool) {
+    pool->parallelFor(cache.entities.size(), COMPOSE_CHUNK_SIZE,
+                      [&](std::size_t begin, std::size_t end) {
+                        composeWorldMatrices(cache.transforms, begin, end,
+                                             cache.matrices.data());
+                      });
+  } else {
+    composeWorldMatrices(cache.transforms, 0, cache.entities.size(),
+                         cache.matrices.data());
+  }
+
+  auto matrices = world.view<WorldMatrix>();
+  for (std::size_t i = 0; i < cache.entities.size(); ++i) {
+    matrices.get<WorldMatrix>(cache.entities[i]).matrix = cache.matrices[i];
+  }
+  world.clear<TransformDirty>();
+}
+
+void storePreviousTranslations(World &world) {
+  for (auto [entity, transform, state] :
+       world.view<const Transform, Interpolated>().each()) {
+    state.previous_translation = transform.translation;
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "components.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <vector>
+
+// Transform components packed as structure of arrays so the matrix
+// composition below can be vectorized by the compiler.
+struct PackedTransforms {
+  std::vector<float> tx, ty, tz;
+  std::vector<float> rx, ry, rz;
+  std::vector<float> sx, sy, sz;
+
+  void clear();
+  void push(const Transform &transform);
+  std::size_t size() const;
+};
+
+// Equivalent to Transform::transform() for the packed elements in
+// [begin, end), written to the same indices of out.
+void composeWorldMatrices(const PackedTransforms &transforms,
+                          std::size_t begin, std::size_t end, glm::mat4 *out);
+
+// Keeps WorldMatrix in sync with Transform. Transforms have to be changed
+// through World::patch/replace for the change to be picked up. Entities get
+// Interpolated along with Move, as the fixed steps move them.
+void registerTransformTracking(World &world);
+// Interpolated entities get the matrix of the translation `alpha` of the way
+// from the previous step to the current one. Matrices are composed on the
+// pool when one is given.
+void updateWorldMatrices(World &world, float alpha = 1.0f,
+                         ThreadPool *pool = nullptr);
+
+// Records the translation of Interpolated entities, run before every fixed
+// step.
+void storePreviousTranslations(World &world);
@@ -0,0 +1,107 @@
+#include "../src/spatial_grid.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Measures sense-radius queries against the SpatialGrid used for clues,
+// next to a brute-force scan over the same positions, with a share of the
+// clues moving every frame.
+//
+// Usage: clue_bench [clue count] [radius] [cell size, default radius]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int FRAMES = 200;
+constexpr int QUERIES_PER_FRAME = 16;
+// Fraction of clues moved every frame
+constexpr float MOVING_SHARE = 0.01f;
+// Clues are spread over a level of this extent, flat like a terrain
+constexpr glm::vec3 LEVEL_SIZE{2000.0f, 50.0f, 2000.0f};
+
+double toUs(Clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                     : 100000;
+  const float radius = argc > 2 ? std::strtof(argv[2], nullptr) : 20.0f;
+  const float cell_size =
+      argc > 3 ? std::strtof(argv[3], nullptr) : radius;
+
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const auto randomPosition = [&] {
+    return glm::vec3(unit(random), unit(random), unit(random)) * LEVEL_SIZE;
+  };
+
+  std::vector<glm::vec3> positions(count);
+  SpatialGrid grid(cell_size);
+  const auto build_start = Clock::now();
+  for (std::size_t i = 0; i < count; ++i) {
+    positions[i] = randomPosition();
+    grid.update(entt::entity(i), positions[i]);
+  }
+  const double build_us = toUs(Clock::now() - build_start);
+
+  const auto moving = std::size_t(float(count) * MOVING_SHARE);
+  std::uniform_int_distribution<std::size_t> pick(0, count - 1);
+  std::vector<entt::entity> hits;
+  double update_us = 0.0;
+  double grid_us = 0.0;
+  double brute_us = 0.0;
+  std::size_t total_hits = 0;
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    const auto update_start = Clock::now();
+    for (std::size_t i = 0; i < moving; ++i) {
+      const std::size_t index = pick(random);
+      positions[index] += (glm::vec3(unit(random), unit(random),
+                                     unit(random)) - 0.5f) * 2.0f;
+      grid.update(entt::entity(index), positions[index]);
+    }
+    update_us += toUs(Clock::now() - update_start);
+
+    for (int q = 0; q < QUERIES_PER_FRAME; ++q) {
+      const glm::vec3 center = randomPosition();
+
+      hits.clear();
+      const auto grid_start = Clock::now();
+      grid.query(center, radius, hits);
+      grid_us += toUs(Clock::now() - grid_start);
+
+      const auto brute_start = Clock::now();
+      std::size_t brute_hits = 0;
+      for (const auto &position : positions) {
+        const glm::vec3 offset = position - center;
+        brute_hits += glm::dot(offset, offset) <= radius * radius ? 1 : 0;
+      }
+      brute_us += toUs(Clock::now() - brute_start);
+
+      if (brute_hits != hits.size()) {
+        std::cerr << "Query mismatch: grid " << hits.size() << ", brute force "
+                  << brute_hits << '\n';
+        return EXIT_FAILURE;
+      }
+      total_hits += hits.size();
+    }
+  }
+
+  const double queries = double(FRAMES) * QUERIES_PER_FRAME;
+  std::cout << "clues: " << count << ", radius: " << radius
+            << ", cell size: " << cell_size << '\n'
+            << "build: " << build_us / 1000.0 << " ms\n"
+            << "update of " << moving << " moving clues: "
+            << update_us / FRAMES << " us/frame\n"
+            << "grid query: " << grid_us / queries << " us\n"
+            << "brute-force query: " << brute_us / queries << " us\n"
+            << "mean clues in range: " << double(total_hits) / queries
+            << '\n';
+  return EXIT_SUCCESS;
+}
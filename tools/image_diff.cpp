@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Compares two binary PPM captures (see --capture) and fails when they
+// differ by more than the given thresholds. Used to check that reduced
+// precision render targets stay visually equivalent to the 32F reference.
+
+namespace {
+
+struct Image {
+  int width{0};
+  int height{0};
+  std::vector<unsigned char> pixels{};
+};
+
+bool readPpm(const char *path, Image &image) {
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int max_value = 0;
+  in >> magic >> image.width >> image.height >> max_value;
+  if (!in || magic != "P6" || max_value != 255) {
+    return false;
+  }
+  in.get();
+  image.pixels.resize(std::size_t(image.width) * image.height * 3);
+  in.read(reinterpret_cast<char *>(image.pixels.data()),
+          std::streamsize(image.pixels.size()));
+  return bool(in);
+}
+
+void printUsage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " <reference.ppm> <image.ppm> [--max-error <0-255>]"
+               " [--min-psnr <dB>]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int max_error = 8;
+  double min_psnr = 40.0;
+  for (int i = 3; i < argc; i += 2) {
+    // A mistyped or incomplete threshold must not fall back to the default
+    // and let a regression pass.
+    if (i + 1 == argc) {
+      std::cerr << "Missing value for " << argv[i] << '\n';
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    if (std::strcmp(argv[i], "--max-error") == 0) {
+      max_error = std::atoi(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--min-psnr") == 0) {
+      min_psnr = std::atof(argv[i + 1]);
+    } else {
+      std::cerr << "Unknown option: " << argv[i] << '\n';
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  Image reference;
+  Image image;
+  if (!readPpm(argv[1], reference) || !readPpm(argv[2], image)) {
+    std::cerr << "Unable to read input images\n";
+    return EXIT_FAILURE;
+  }
+  if (reference.width != image.width || reference.height != image.height) {
+    std::cerr << "Image sizes differ\n";
+    return EXIT_FAILURE;
+  }
+
+  int worst = 0;
+  double squared_sum = 0.0;
+  for (std::size_t i = 0; i < reference.pixels.size(); ++i) {
+    const int difference =
+        std::abs(int(reference.pixels[i]) - int(image.pixels[i]));
+    worst = std::max(worst, difference);
+    squared_sum += double(difference) * difference;
+  }
+  const double mse = squared_sum / double(reference.pixels.size());
+  const double psnr =
+      mse == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+
+  std::cout << "max error " << worst << ", psnr " << psnr << " dB\n";
+  if (worst > max_error || psnr < min_psnr) {
+    std::cerr << "Images differ more than allowed (max error " << max_error
+              << ", min psnr " << min_psnr << " dB)\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
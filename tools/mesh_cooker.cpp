@@ -0,0 +1,85 @@
+#include "../src/mesh_data.h"
+#include "../src/mesh_optimizer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Imports meshes with Assimp and writes the binary cache next to each
+// source file, so the application can skip the import at startup. Prints
+// the triangles of each LOD and the vertex cache efficiency of the
+// optimized index order of the full mesh.
+//
+// Usage: mesh_cooker [--layout full|compact] <mesh>...
+
+namespace {
+
+std::vector<uint32_t> unpackIndices(const MeshData &mesh, const MeshLod &lod) {
+  const auto bytes = mesh.getIndices();
+  std::vector<uint32_t> indices(lod.index_count);
+  for (std::size_t i = 0; i < indices.size(); ++i) {
+    const std::size_t index = lod.first_index + i;
+    if (mesh.getFormat().index_size == 2) {
+      uint16_t value;
+      std::memcpy(&value, bytes.data() + index * 2, 2);
+      indices[i] = value;
+    } else {
+      std::memcpy(&indices[i], bytes.data() + index * 4, 4);
+    }
+  }
+  return indices;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  VertexLayout layout = VertexLayout::Full;
+  int first = 1;
+  if (argc > 2 && std::strcmp(argv[1], "--layout") == 0) {
+    const auto parsed = parseVertexLayout(argv[2]);
+    if (!parsed) {
+      std::cerr << "Unknown layout: " << argv[2] << '\n';
+      return EXIT_FAILURE;
+    }
+    layout = *parsed;
+    first = 3;
+  }
+  if (first >= argc) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--layout full|compact] <mesh>...\n";
+    return EXIT_FAILURE;
+  }
+
+  int result = EXIT_SUCCESS;
+  for (int i = first; i < argc; ++i) {
+    const char *path = argv[i];
+    const auto mesh = importMesh(path, layout);
+    if (!mesh) {
+      std::cerr << "Unable to load: " << path << '\n';
+      result = EXIT_FAILURE;
+      continue;
+    }
+    if (!writeMeshCache(path, *mesh)) {
+      std::cerr << "Unable to write: " << getMeshCachePath(path) << '\n';
+      result = EXIT_FAILURE;
+      continue;
+    }
+    const MeshFormat &format = mesh->getFormat();
+    const auto stats = analyzeVertexCache(
+        unpackIndices(*mesh, format.lods[0]), format.vertex_count);
+    std::cout << getMeshCachePath(path) << ": "
+              << getVertexLayoutName(format.layout) << ", "
+              << format.vertex_count << " vertices, " << format.index_count
+              << " indices, "
+              << mesh->getVertices().size_bytes() +
+                     mesh->getIndices().size_bytes()
+              << " bytes, ACMR " << stats.acmr << ", ATVR " << stats.atvr
+              << "\n  LOD triangles:";
+    for (uint32_t lod = 0; lod < format.lod_count; ++lod) {
+      std::cout << ' ' << format.lods[lod].index_count / 3;
+    }
+    std::cout << '\n';
+  }
+  return result;
+}
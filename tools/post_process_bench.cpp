@@ -0,0 +1,222 @@
+#include "../src/post_process_cpu.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+// Times the CPU outline, compose and tonemap kernels at window size on a
+// synthetic frame with one trace and one interesting clue. Each kernel runs
+// in its scalar and its SSE version, once on the calling thread and once
+// spread over a thread pool. The pool has to reproduce the single thread
+// images exactly and the SSE versions the scalar ones within
+// SIMD_TOLERANCE. Optionally writes the composed frame as PPM.
+//
+// Usage: post_process_bench [runs] [output.ppm]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int WIDTH = 1280;
+constexpr int HEIGHT = 720;
+constexpr int OUTLINE_SIZE = 512;
+// Outline updates before timing, so the history is not empty
+constexpr int WARMUP_STEPS = 60;
+
+double toMs(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Lit gradient with two clues drawn as discs, the trace tagged in the green
+// channel of the intensity mask and the interesting one in red.
+void createFrame(FloatImage &color, FloatImage &intensity) {
+  color = FloatImage(WIDTH, HEIGHT);
+  intensity = FloatImage(WIDTH, HEIGHT);
+  const std::array<glm::vec3, 2> clues{glm::vec3(400.0f, 300.0f, 90.0f),
+                                       glm::vec3(900.0f, 400.0f, 60.0f)};
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      const glm::vec2 position{float(x), float(y)};
+      glm::vec4 mask(0.0f, 0.0f, 0.0f, 1.0f);
+      glm::vec3 lit(0.3f + 0.5f * float(y) / float(HEIGHT));
+      for (std::size_t i = 0; i < clues.size(); ++i) {
+        const glm::vec2 offset = position - glm::vec2(clues[i].x, clues[i].y);
+        if (glm::dot(offset, offset) < clues[i].z * clues[i].z) {
+          mask[int(1 - i)] = 1.0f;
+          lit = glm::vec3(0.9f, 0.6f, 0.4f);
+        }
+      }
+      color.at(x, y) = glm::vec4(lit, 1.0f);
+      intensity.at(x, y) = mask;
+    }
+  }
+}
+
+std::array<glm::vec2, 8> computeCircleDirections(float time) {
+  std::array<glm::vec2, 8> directions{};
+  for (int i = 0; i < 8; ++i) {
+    const float angle = float(i) * 3.1415f / 4.0f - time * 0.1f;
+    directions[i] = {std::cos(angle), std::sin(angle)};
+  }
+  return directions;
+}
+
+// Copies the active region of an outline update into a full texture.
+void storeOutline(const FloatImage &state, FloatImage &texture) {
+  for (int y = 0; y < state.height; ++y) {
+    for (int x = 0; x < state.width; ++x) {
+      texture.at(x, y) = state.at(x, y);
+    }
+  }
+}
+
+bool writePpm(const char *path, const FloatImage &image) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    return false;
+  }
+  out << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+  // Rows start at the bottom like GL, PPM rows at the top.
+  for (int y = image.height - 1; y >= 0; --y) {
+    for (int x = 0; x < image.width; ++x) {
+      for (int c = 0; c < 3; ++c) {
+        const float value = std::clamp(image.at(x, y)[c], 0.0f, 1.0f);
+        out.put(char(std::lround(value * 255.0f)));
+      }
+    }
+  }
+  return bool(out);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int runs = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 20;
+  const char *output = argc > 2 ? argv[2] : nullptr;
+
+  FloatImage color;
+  FloatImage intensity;
+  createFrame(color, intensity);
+
+  ThreadPool pool;
+  OutlineInputs outline_inputs{OUTLINE_SIZE, OUTLINE_SIZE, glm::vec2(1.0f),
+                               0.0f};
+  FloatImage history(OUTLINE_SIZE, OUTLINE_SIZE);
+  FloatImage state;
+  for (int i = 0; i < WARMUP_STEPS; ++i) {
+    // Frames at 60 Hz, the noise changes with time.
+    outline_inputs.time = float(i) / 60.0f;
+    updateOutlineCpu(intensity, history, outline_inputs, state, &pool);
+    storeOutline(state, history);
+  }
+  const float time = outline_inputs.time;
+  FloatImage classes;
+  packOutlineClassesCpu(history, OUTLINE_SIZE, classes);
+
+  const ComposeInputs compose_inputs{1.0f, glm::vec2(1.0f), glm::vec2(1.0f),
+                                     computeCircleDirections(time), true};
+
+  // The SSE kernels read planes, converted once outside the timing.
+  const PlanarImage planar_color = toPlanarImage(color);
+  const PlanarImage planar_intensity = toPlanarImage(intensity);
+  const PlanarImage planar_history = toPlanarImage(history);
+  const PlanarImage planar_classes = toPlanarImage(classes);
+
+  struct Kernel {
+    const char *name;
+    std::function<void(FloatImage &, ThreadPool *)> scalar;
+    std::function<void(PlanarImage &, ThreadPool *)> simd;
+  };
+  const Kernel kernels[] = {
+      {"outline",
+       [&](FloatImage &out, ThreadPool *pool) {
+         updateOutlineCpu(intensity, history, outline_inputs, out, pool);
+       },
+       [&](PlanarImage &out, ThreadPool *pool) {
+         updateOutlineSimd(planar_intensity, planar_history, outline_inputs,
+                           out, pool);
+       }},
+      {"compose",
+       [&](FloatImage &out, ThreadPool *pool) {
+         composeCpu(color, classes, intensity, compose_inputs, out, pool);
+       },
+       [&](PlanarImage &out, ThreadPool *pool) {
+         composeSimd(planar_color, planar_classes, planar_intensity,
+                     compose_inputs, out, pool);
+       }},
+      {"tonemap",
+       [&](FloatImage &out, ThreadPool *pool) {
+         tonemapCpu(color, out, pool);
+       },
+       [&](PlanarImage &out, ThreadPool *pool) {
+         tonemapSimd(planar_color, out, pool);
+       }},
+  };
+
+  // Average time of `runs` calls in ms.
+  const auto time_runs = [runs](const auto &fn) {
+    const auto start = Clock::now();
+    for (int i = 0; i < runs; ++i) {
+      fn();
+    }
+    return toMs(Clock::now() - start) / runs;
+  };
+
+  std::cout << "Threads: " << pool.getThreadCount() + 1 << ", runs: " << runs
+            << '\n';
+  int result = EXIT_SUCCESS;
+  for (const auto &kernel : kernels) {
+    FloatImage scalar_serial;
+    FloatImage scalar_parallel;
+    PlanarImage simd_serial;
+    PlanarImage simd_parallel;
+    const double scalar_serial_ms =
+        time_runs([&] { kernel.scalar(scalar_serial, nullptr); });
+    const double scalar_parallel_ms =
+        time_runs([&] { kernel.scalar(scalar_parallel, &pool); });
+    const double simd_serial_ms =
+        time_runs([&] { kernel.simd(simd_serial, nullptr); });
+    const double simd_parallel_ms =
+        time_runs([&] { kernel.simd(simd_parallel, &pool); });
+
+    std::cout << kernel.name << ":\n  scalar: serial " << scalar_serial_ms
+              << " ms, pool " << scalar_parallel_ms << " ms ("
+              << scalar_serial_ms / scalar_parallel_ms << "x)\n"
+              << "  sse:    serial " << simd_serial_ms << " ms ("
+              << scalar_serial_ms / simd_serial_ms << "x), pool "
+              << simd_parallel_ms << " ms ("
+              << scalar_serial_ms / simd_parallel_ms << "x)\n";
+
+    const FloatImage simd_image = toFloatImage(simd_serial);
+    const float pool_difference =
+        std::max(getMaxDifference(scalar_serial, scalar_parallel),
+                 getMaxDifference(simd_image, toFloatImage(simd_parallel)));
+    const float simd_difference = getMaxDifference(scalar_serial, simd_image);
+    std::cout << "  sse max difference " << simd_difference << '\n';
+    if (pool_difference != 0.0f) {
+      std::cerr << kernel.name << ": pool result differs by "
+                << pool_difference << '\n';
+      result = EXIT_FAILURE;
+    }
+    if (simd_difference > SIMD_TOLERANCE) {
+      std::cerr << kernel.name << ": sse result differs by "
+                << simd_difference << '\n';
+      result = EXIT_FAILURE;
+    }
+  }
+
+  if (output) {
+    FloatImage composed;
+    composeCpu(color, classes, intensity, compose_inputs, composed, &pool);
+    if (!writePpm(output, composed)) {
+      std::cerr << "Unable to write: " << output << '\n';
+      result = EXIT_FAILURE;
+    }
+  }
+  return result;
+}